@@ -0,0 +1,185 @@
+/**
+ * @file adaptive.c
+ *
+ * Adapting the queue's concurrency limit to the load.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "adaptive.h"
+
+static const char * pressureFiles[] = { "/proc/pressure/cpu", "/proc/pressure/io", "/proc/pressure/memory", NULL };
+
+/**
+ * @brief how stalled the system is
+ * @return the highest 'some avg10' of cpu, io and memory, in percent, or a negative
+ *         number if the kernel doesn't provide PSI
+ */
+static double readPressure( void )
+{
+    double worst = -1.0;
+
+    for ( int i = 0; pressureFiles[i] != NULL; ++i )
+    {
+        FILE * file = fopen( pressureFiles[i], "re" );
+        if ( file == NULL )
+        {
+            continue;
+        }
+
+        char   line[ 128 ];
+        double avg10;
+        while ( fgets( line, sizeof( line ), file ) != NULL )
+        {
+            if ( sscanf( line, "some avg10=%lf", &avg10 ) == 1 && avg10 > worst )
+            {
+                worst = avg10;
+            }
+        }
+        fclose( file );
+    }
+    return worst;
+}
+
+/**
+ * @brief read the settings, and set the starting limit. Called by the leader with the queue locked.
+ * @param adaptive
+ * @param state
+ * @param limit the configured 'queue.limit'
+ */
+void adaptiveInit( tAdaptive * adaptive, tQueueState * state, long limit )
+{
+    memset( adaptive, 0, sizeof( tAdaptive ) );
+
+    adaptive->maxLimit = getConfigNumber( "queue.maxLimit", 0 );
+    adaptive->minLimit = getConfigNumber( "queue.minLimit", 1 );
+    adaptive->enabled  = ( adaptive->maxLimit > limit );
+    if ( !adaptive->enabled )
+    {
+        state->limit = 0;
+        return;
+    }
+
+    if ( adaptive->minLimit < 1 )
+    {
+        adaptive->minLimit = 1;
+    }
+    adaptive->interval  = parseDuration( getConfigString( "queue.adjustInterval", NULL ), kAdaptiveInterval ) * 1000000000ULL;
+    adaptive->pressure  = getConfigNumber( "queue.pressure", kAdaptivePressure );
+    adaptive->tolerance = getConfigNumber( "queue.latencyTolerance", kAdaptiveTolerance ) / 100.0;
+
+    /* carry on from where the last leader left off, rather than relearning it all after every idle spell */
+    if ( state->limit < adaptive->minLimit || state->limit > adaptive->maxLimit )
+    {
+        state->limit = ( limit < adaptive->minLimit ) ? adaptive->minLimit : limit;
+    }
+    adaptive->baseline   = state->baseline;
+    adaptive->throughput = state->throughput;
+
+    adaptive->reviewed  = nowNanoseconds( CLOCK_MONOTONIC );
+    adaptive->completed = state->completed;
+    adaptive->busyTime  = state->busyTime;
+}
+
+/**
+ * @brief called by the leader after each round of granting slots, with the queue locked.
+ *        Reviews the limit once every interval.
+ * @param adaptive
+ * @param state
+ * @param running chains running now
+ * @param waiting chains still waiting
+ */
+void adaptiveUpdate( tAdaptive * adaptive, tQueueState * state, long running, long waiting )
+{
+    if ( !adaptive->enabled )
+    {
+        return;
+    }
+
+    if ( running >= (long)state->limit && waiting > 0 )
+    {
+        adaptive->saturated = true;
+    }
+
+    uint64_t now = nowNanoseconds( CLOCK_MONOTONIC );
+    if ( now - adaptive->reviewed < adaptive->interval )
+    {
+        return;
+    }
+
+    double   seconds    = ( now - adaptive->reviewed ) / 1e9;
+    uint64_t completed  = state->completed - adaptive->completed;
+    double   throughput = completed / seconds;
+    double   latency    = ( completed > 0 ) ? ( state->busyTime - adaptive->busyTime ) / 1e9 / completed : 0.0;
+    double   pressure   = readPressure();
+
+    uint32_t     limit  = state->limit;
+    const char * reason = NULL;
+    if ( pressure > adaptive->pressure )
+    {
+        reason = "system under pressure";
+    }
+    else if ( completed > 0 && adaptive->baseline > 0.0 && latency > adaptive->baseline * adaptive->tolerance
+           && throughput <= adaptive->throughput )
+    {
+        reason = "chains slowing without completing faster";
+    }
+
+    if ( reason != NULL )
+    {
+        uint32_t cut = ( limit / 4 > 0 ) ? limit / 4 : 1;
+        limit = ( limit > adaptive->minLimit + cut ) ? limit - cut : adaptive->minLimit;
+    }
+    else if ( adaptive->saturated && limit < adaptive->maxLimit )
+    {
+        reason = "every slot in use, with chains waiting";
+        ++limit;
+    }
+
+    if ( limit != state->limit )
+    {
+        syslog( LOG_INFO, "queue limit %u -> %u, %s (%.2f chains/s, mean %.1fs vs baseline %.1fs, "
+                          "pressure %.1f%%, %ld running, %ld waiting)",
+                state->limit, limit, reason, throughput, latency, adaptive->baseline,
+                pressure, running, waiting );
+        state->limit = limit;
+    }
+    else
+    {
+        syslog( LOG_DEBUG, "queue limit stays at %u (%.2f chains/s, mean %.1fs vs baseline %.1fs, "
+                           "pressure %.1f%%, %ld running, %ld waiting)",
+                limit, throughput, latency, adaptive->baseline, pressure, running, waiting );
+    }
+
+    if ( completed > 0 )
+    {
+        /* the baseline drifts up slowly, so it follows a lasting change in the kind of work */
+        if ( adaptive->baseline <= 0.0 || latency < adaptive->baseline )
+        {
+            adaptive->baseline = latency;
+        }
+        else
+        {
+            adaptive->baseline *= 1.02;
+        }
+    }
+    adaptive->throughput = throughput;
+    adaptive->saturated  = false;
+    adaptive->reviewed   = now;
+    adaptive->completed  = state->completed;
+    adaptive->busyTime   = state->busyTime;
+
+    state->baseline   = adaptive->baseline;
+    state->throughput = adaptive->throughput;
+}
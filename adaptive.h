@@ -0,0 +1,53 @@
+/**
+ * @file adaptive.h
+ *
+ * Adapting the queue's concurrency limit to the load. Enabled by setting
+ * 'queue.maxLimit' above 'queue.limit', which becomes the starting point. The
+ * queue leader reviews the limit every 'queue.adjustInterval', using additive
+ * increase and multiplicative decrease:
+ *
+ *   - if the system is stalling (the worst 10s PSI average for cpu, io or memory
+ *     exceeds 'queue.pressure' percent), or chains are taking much longer than
+ *     they have been without completing any faster, the limit is cut by a quarter.
+ *   - otherwise, if every slot is in use and chains are waiting, it goes up by one.
+ *
+ * The limit stays between 'queue.minLimit' and 'queue.maxLimit', and every change
+ * is logged with the figures behind it. The limit, the latency baseline and the
+ * last throughput are kept in the shared queue state, so a leader that starts after
+ * the last one went idle carries on from them instead of starting over.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_ADAPTIVE_H
+#define CUCKOO_ADAPTIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "queue.h"
+
+#define kAdaptiveInterval       10      /* seconds between reviews */
+#define kAdaptivePressure       20      /* percent of time stalled */
+#define kAdaptiveTolerance      150     /* percent of the baseline latency that counts as 'much longer' */
+
+typedef struct {
+    bool      enabled;
+    uint32_t  minLimit;
+    uint32_t  maxLimit;
+    uint64_t  interval;         /* nanoseconds */
+    double    pressure;         /* percent */
+    double    tolerance;        /* ratio */
+
+    uint64_t  reviewed;         /* CLOCK_MONOTONIC of the last review */
+    uint64_t  completed;        /* tQueueState.completed at the last review */
+    uint64_t  busyTime;         /* tQueueState.busyTime at the last review */
+    double    throughput;       /* chains per second over the last interval */
+    double    baseline;         /* the lowest recent mean chain duration, in seconds */
+    bool      saturated;        /* every slot was in use at some point during the interval */
+} tAdaptive;
+
+void adaptiveInit(   tAdaptive * adaptive, tQueueState * state, long limit );
+void adaptiveUpdate( tAdaptive * adaptive, tQueueState * state, long running, long waiting );
+
+#endif /* CUCKOO_ADAPTIVE_H */
@@ -0,0 +1,562 @@
+/**
+ * @file analyze.c
+ *
+ * Inferring the dependencies between hooks from the files they access.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <linux/limits.h>
+
+#include "report.h"
+#include "history.h"
+#include "hookdata.h"
+#include "analyze.h"
+
+/* long enough for '/proc/<pid>/fdinfo/<fd>', with both taken from directory entries */
+#define kProcPathMax    ( sizeof( "/proc//fdinfo/" ) + 2 * NAME_MAX )
+
+/* files every hook touches, that never carry data from one hook to the next */
+static const char * ignoredPrefixes[] = { "/dev/", "/proc/", "/sys/", "/run/", "/tmp/.X11-unix/", NULL };
+
+/**
+ * @brief note that a hook had 'path' open, merging with what's already been seen
+ */
+static void recordAccess( tAnalyzedHook * hook, const char * path, uint32_t access )
+{
+    tFileAccess * file = NULL;
+    for ( size_t i = 0; i < hook->count; ++i )
+    {
+        if ( strcmp( hook->files[i].path, path ) == 0 )
+        {
+            file = &hook->files[i];
+            break;
+        }
+    }
+
+    if ( file == NULL )
+    {
+        if ( hook->count >= hook->allocated )
+        {
+            size_t allocated = hook->allocated ? hook->allocated * 2 : 32;
+            tFileAccess * files = realloc( hook->files, allocated * sizeof( tFileAccess ) );
+            if ( files == NULL )
+            {
+                return;
+            }
+            hook->files     = files;
+            hook->allocated = allocated;
+        }
+        file = &hook->files[ hook->count ];
+        file->path = strdup( path );
+        if ( file->path == NULL )
+        {
+            return;
+        }
+        file->access = access;
+        ++hook->count;
+        return;
+    }
+
+    /* it's only append-only if every write we've seen was an append */
+    if ( ( file->access & kAccessWrite ) && ( access & kAccessWrite ) )
+    {
+        access &= ( file->access | ~kAccessAppend );
+        file->access &= ~kAccessAppend;
+    }
+    file->access |= access;
+}
+
+/**
+ * @brief record the files one process has open
+ */
+static void sampleProcess( const tAnalysis * analysis, tAnalyzedHook * hook, const char * pid,
+                           const char * executable )
+{
+    char dirPath[ kProcPathMax ];
+    snprintf( dirPath, sizeof( dirPath ), "/proc/%s/fd", pid );
+
+    DIR * dir = opendir( dirPath );
+    if ( dir == NULL )
+    {
+        /* it's already gone */
+        return;
+    }
+
+    struct dirent * entry;
+    while ( ( entry = readdir( dir ) ) != NULL )
+    {
+        if ( !isdigit( (unsigned char)entry->d_name[0] ) )
+        {
+            continue;
+        }
+
+        char linkPath[ kProcPathMax ];
+        char path[ PATH_MAX ];
+        snprintf( linkPath, sizeof( linkPath ), "/proc/%s/fd/%s", pid, entry->d_name );
+        ssize_t len = readlink( linkPath, path, sizeof( path ) - 1 );
+        if ( len <= 0 || path[0] != '/' )
+        {
+            /* pipes, sockets and the like */
+            continue;
+        }
+        path[ len ] = '\0';
+
+        bool ignore = ( strcmp( path, executable ) == 0 )
+                   || ( len > 10 && strcmp( &path[ len - 10 ], " (deleted)" ) == 0 );
+        for ( int i = 0; !ignore && i < 3; ++i )
+        {
+            ignore = ( analysis->inherited[i] != NULL && strcmp( path, analysis->inherited[i] ) == 0 );
+        }
+        for ( int i = 0; !ignore && ignoredPrefixes[i] != NULL; ++i )
+        {
+            ignore = ( strncmp( path, ignoredPrefixes[i], strlen( ignoredPrefixes[i] ) ) == 0 );
+        }
+        if ( ignore )
+        {
+            continue;
+        }
+
+        /* the 'flags:' line of fdinfo has the open() flags, in octal */
+        char infoPath[ kProcPathMax ];
+        snprintf( infoPath, sizeof( infoPath ), "/proc/%s/fdinfo/%s", pid, entry->d_name );
+        FILE * info = fopen( infoPath, "re" );
+        if ( info == NULL )
+        {
+            continue;
+        }
+        char line[ 64 ];
+        unsigned long flags = 0;
+        bool found = false;
+        while ( !found && fgets( line, sizeof( line ), info ) != NULL )
+        {
+            found = ( sscanf( line, "flags: %lo", &flags ) == 1 );
+        }
+        fclose( info );
+        if ( !found )
+        {
+            continue;
+        }
+
+        uint32_t access = 0;
+        switch ( flags & O_ACCMODE )
+        {
+        case O_RDONLY: access = kAccessRead; break;
+        case O_WRONLY: access = kAccessWrite; break;
+        default:       access = kAccessRead | kAccessWrite; break;
+        }
+        if ( ( access & kAccessWrite ) && ( flags & O_APPEND ) )
+        {
+            access |= kAccessAppend;
+        }
+        recordAccess( hook, path, access );
+    }
+    closedir( dir );
+}
+
+/**
+ * @brief record the files open in every process in the hook's process group
+ */
+static void sampleHook( const tAnalysis * analysis, tAnalyzedHook * hook, pid_t pgrp, const char * executable )
+{
+    DIR * proc = opendir( "/proc" );
+    if ( proc == NULL )
+    {
+        return;
+    }
+
+    struct dirent * entry;
+    while ( ( entry = readdir( proc ) ) != NULL )
+    {
+        if ( !isdigit( (unsigned char)entry->d_name[0] ) )
+        {
+            continue;
+        }
+
+        char statPath[ kProcPathMax ];
+        char stat[ 512 ];
+        snprintf( statPath, sizeof( statPath ), "/proc/%s/stat", entry->d_name );
+        int fd = open( statPath, O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 )
+        {
+            continue;
+        }
+        ssize_t len = read( fd, stat, sizeof( stat ) - 1 );
+        close( fd );
+        if ( len <= 0 )
+        {
+            continue;
+        }
+        stat[ len ] = '\0';
+
+        /* 'pid (comm) state ppid pgrp ...' - comm may itself contain spaces and parentheses */
+        const char * fields = strrchr( stat, ')' );
+        char state;
+        int  ppid, group;
+        if ( fields != NULL && sscanf( fields + 1, " %c %d %d", &state, &ppid, &group ) == 3 && group == pgrp )
+        {
+            sampleProcess( analysis, hook, entry->d_name, executable );
+        }
+    }
+    closedir( proc );
+    ++hook->samples;
+}
+
+/**
+ * @brief add what a hook passed on to what the chain has so far, replacing any earlier values,
+ *        and note which keys it was
+ * @param analysis
+ * @param hook
+ * @param mine the hook's variables - they're moved, leaving it empty
+ */
+static void mergeVars( tAnalysis * analysis, tAnalyzedHook * hook, tHookVars * mine )
+{
+    tHookVars * vars   = &analysis->vars;
+    size_t      length = 0;
+
+    for ( size_t i = 0; i < mine->count; ++i )
+    {
+        length += strcspn( mine->vars[i], "=" ) + 1;
+    }
+    hook->passed = ( mine->count > 0 ) ? calloc( 1, length ) : NULL;
+
+    for ( size_t i = 0; i < mine->count; ++i )
+    {
+        char * var     = mine->vars[i];
+        size_t nameLen = strcspn( var, "=" );
+
+        if ( hook->passed != NULL )
+        {
+            if ( i > 0 )
+            {
+                strcat( hook->passed, " " );
+            }
+            strncat( hook->passed, var, nameLen );
+        }
+
+        size_t j = 0;
+        while ( j < vars->count && strncmp( vars->vars[j], var, nameLen + 1 ) != 0 )
+        {
+            ++j;
+        }
+        if ( j == vars->count )
+        {
+            char ** grown = realloc( vars->vars, ( vars->count + 2 ) * sizeof( char * ) );
+            if ( grown == NULL )
+            {
+                continue;
+            }
+            vars->vars = grown;
+            vars->vars[ ++vars->count ] = NULL;
+        }
+        else
+        {
+            vars->size -= strlen( vars->vars[j] ) + 1;
+            free( vars->vars[j] );
+        }
+        vars->vars[j]  = var;
+        vars->size    += strlen( var ) + 1;
+        mine->vars[i]  = NULL;
+    }
+    freeHookVars( mine );
+}
+
+/**
+ * @brief run one hook to completion, sampling the files it accesses as it goes. As it would be
+ *        normally, it's given what earlier hooks passed on, and the data channel if it has one.
+ * @param analysis
+ * @param name the hook's name, for the report
+ * @param argv argv[0] is the path to the hook
+ * @param envp
+ * @return the hook's exit code
+ */
+int analyzeHook( tAnalysis * analysis, const char * name, char * argv[], char * envp[] )
+{
+    if ( analysis->count == 0 )
+    {
+        for ( int i = 0; i < 3; ++i )
+        {
+            char fdPath[ 32 ];
+            char path[ PATH_MAX ];
+            snprintf( fdPath, sizeof( fdPath ), "/proc/self/fd/%d", i );
+            ssize_t len = readlink( fdPath, path, sizeof( path ) - 1 );
+            if ( len > 0 )
+            {
+                path[ len ] = '\0';
+                analysis->inherited[i] = strdup( path );
+            }
+        }
+    }
+
+    if ( analysis->count >= analysis->allocated )
+    {
+        size_t allocated = analysis->allocated ? analysis->allocated * 2 : 16;
+        tAnalyzedHook * hooks = realloc( analysis->hooks, allocated * sizeof( tAnalyzedHook ) );
+        if ( hooks == NULL )
+        {
+            return reportErrno( "unable to allocate memory" );
+        }
+        analysis->hooks     = hooks;
+        analysis->allocated = allocated;
+    }
+    tAnalyzedHook * hook = &analysis->hooks[ analysis->count++ ];
+    memset( hook, 0, sizeof( tAnalyzedHook ) );
+    hook->name = strdup( name );
+
+    tHookVars mine = { NULL, 0, 0 };
+    tHookData data;
+    char      dataVar[ 32 ];
+    bool      hasData = hookDataOpen( &data, name, &mine );
+    if ( hasData )
+    {
+        snprintf( dataVar, sizeof( dataVar ), "%s=%d", kHookDataFdEnvVar, data.writeFd );
+    }
+
+    uint64_t started = nowNanoseconds( CLOCK_MONOTONIC );
+
+    pid_t pid = fork();
+    switch ( pid )
+    {
+    case -1:
+        hookDataClose( &data );
+        return reportErrno( "unable to launch \'%s\'", argv[0] );
+
+    case 0:
+        /* a process group of its own, so we can find everything it starts */
+        setpgid( 0, 0 );
+        /* we're a copy, so the environment can simply be added to */
+        environ = envp;
+        for ( size_t i = 0; i < analysis->vars.count; ++i )
+        {
+            putenv( analysis->vars.vars[i] );
+        }
+        if ( hasData )
+        {
+            putenv( dataVar );
+            /* the pipe is close-on-exec, but the hook's end needs to survive it */
+            fcntl( data.writeFd, F_SETFD, 0 );
+        }
+        execve( argv[0], argv, environ );
+        reportErrno( "unable to execute \'%s\'", argv[0] );
+        _exit( 127 );
+
+    default:
+        break;
+    }
+    setpgid( pid, pid );
+    hookDataStarted( &data );
+
+    int status = 0;
+    struct timespec interval = { 0, kAnalyzeInterval * 1000000L };
+    for (;;)
+    {
+        sampleHook( analysis, hook, pid, argv[0] );
+        /* keep the pipe from filling, and the hook blocking on it */
+        hookDataRead( &data );
+
+        pid_t done = waitpid( pid, &status, WNOHANG );
+        if ( done == pid || ( done < 0 && errno != EINTR ) )
+        {
+            break;
+        }
+        nanosleep( &interval, NULL );
+    }
+
+    hook->duration = nowNanoseconds( CLOCK_MONOTONIC ) - started;
+    hookDataClose( &data );
+    mergeVars( analysis, hook, &mine );
+
+    if ( WIFEXITED( status ) )
+    {
+        hook->result = WEXITSTATUS( status );
+    }
+    else if ( WIFSIGNALED( status ) )
+    {
+        hook->result = 128 + WTERMSIG( status );
+    }
+    return hook->result;
+}
+
+/**
+ * @brief why 'later' can't run alongside 'earlier', if it can't
+ * @return the file that conflicts, or NULL if they're independent
+ */
+static const char * findConflict( const tAnalyzedHook * earlier, const tAnalyzedHook * later,
+                                  const char ** why, size_t * conflicts )
+{
+    const char * first = NULL;
+
+    *conflicts = 0;
+    for ( size_t i = 0; i < later->count; ++i )
+    {
+        const tFileAccess * mine = &later->files[i];
+        for ( size_t j = 0; j < earlier->count; ++j )
+        {
+            const tFileAccess * theirs = &earlier->files[j];
+            if ( strcmp( mine->path, theirs->path ) != 0 )
+            {
+                continue;
+            }
+
+            const char * reason = NULL;
+            if ( ( mine->access & kAccessRead ) && ( theirs->access & kAccessWrite ) )
+            {
+                reason = "reads what it wrote";
+            }
+            else if ( ( mine->access & kAccessWrite ) && ( theirs->access & kAccessRead ) )
+            {
+                reason = "overwrites what it read";
+            }
+            else if ( ( mine->access & kAccessWrite ) && ( theirs->access & kAccessWrite )
+                   && !( ( mine->access & kAccessAppend ) && ( theirs->access & kAccessAppend ) ) )
+            {
+                reason = "writes what it wrote";
+            }
+
+            if ( reason != NULL )
+            {
+                if ( first == NULL )
+                {
+                    first = mine->path;
+                    *why  = reason;
+                }
+                ++*conflicts;
+            }
+            break;
+        }
+    }
+    return first;
+}
+
+/**
+ * @brief print what each hook accessed, the dependencies that implies, and the stages
+ *        the chain could be split into
+ * @param analysis
+ */
+void reportAnalysis( tAnalysis * analysis )
+{
+    for ( size_t i = 0; i < analysis->count; ++i )
+    {
+        tAnalyzedHook * hook = &analysis->hooks[i];
+        char duration[ 16 ];
+
+        printf( "%s: exit %d after %s, %u sample%s\n", hook->name, hook->result,
+                formatDuration( hook->duration, duration, sizeof( duration ) ),
+                hook->samples, hook->samples == 1 ? "" : "s" );
+        if ( hook->samples < 2 )
+        {
+            printf( "    (too quick to sample reliably)\n" );
+        }
+        if ( hook->passed != NULL )
+        {
+            printf( "    passes on %s\n", hook->passed );
+        }
+        for ( size_t j = 0; j < hook->count; ++j )
+        {
+            const tFileAccess * file = &hook->files[j];
+            printf( "    %c%c%c %s\n",
+                    ( file->access & kAccessRead )   ? 'r' : '-',
+                    ( file->access & kAccessWrite )  ? 'w' : '-',
+                    ( file->access & kAccessAppend ) ? 'a' : '-',
+                    file->path );
+        }
+    }
+
+    /* sampling only catches files held open at the moment of a sample, on this run's arguments */
+    printf( "\ndependencies (a lower bound - there may be others the samples missed):\n" );
+    int stages = 0;
+    for ( size_t i = 0; i < analysis->count; ++i )
+    {
+        tAnalyzedHook * later = &analysis->hooks[i];
+        later->stage = 0;
+        for ( size_t j = 0; j < i; ++j )
+        {
+            const tAnalyzedHook * earlier = &analysis->hooks[j];
+            const char * why;
+            size_t       conflicts;
+            const char * path = findConflict( earlier, later, &why, &conflicts );
+            if ( earlier->passed != NULL )
+            {
+                /* there's no telling which of its variables a hook uses, so any may */
+                printf( "    %s after %s: may use what it passed on (%s)\n", later->name, earlier->name,
+                        earlier->passed );
+                if ( later->stage <= earlier->stage )
+                {
+                    later->stage = earlier->stage + 1;
+                }
+            }
+            else if ( path != NULL )
+            {
+                printf( "    %s after %s: %s (%s", later->name, earlier->name, why, path );
+                if ( conflicts > 1 )
+                {
+                    printf( " and %zu other%s", conflicts - 1, conflicts == 2 ? "" : "s" );
+                }
+                printf( ")\n" );
+                if ( later->stage <= earlier->stage )
+                {
+                    later->stage = earlier->stage + 1;
+                }
+            }
+        }
+        if ( later->stage + 1 > stages )
+        {
+            stages = later->stage + 1;
+        }
+    }
+
+    printf( "\nproposed stages (review before applying - hooks are grouped only because no conflict was seen):\n" );
+    for ( int stage = 0; stage < stages; ++stage )
+    {
+        printf( "    %d:", stage + 1 );
+        for ( size_t i = 0; i < analysis->count; ++i )
+        {
+            if ( analysis->hooks[i].stage == stage )
+            {
+                printf( " %s", analysis->hooks[i].name );
+            }
+        }
+        printf( "\n" );
+    }
+    if ( stages == (int)analysis->count && stages > 1 )
+    {
+        printf( "no two hooks were seen to be independent\n" );
+    }
+}
+
+void freeAnalysis( tAnalysis * analysis )
+{
+    for ( size_t i = 0; i < analysis->count; ++i )
+    {
+        for ( size_t j = 0; j < analysis->hooks[i].count; ++j )
+        {
+            free( analysis->hooks[i].files[j].path );
+        }
+        free( analysis->hooks[i].files );
+        free( analysis->hooks[i].passed );
+        free( analysis->hooks[i].name );
+    }
+    free( analysis->hooks );
+    for ( int i = 0; i < 3; ++i )
+    {
+        free( analysis->inherited[i] );
+        analysis->inherited[i] = NULL;
+    }
+    freeHookVars( &analysis->vars );
+    analysis->hooks     = NULL;
+    analysis->count     = 0;
+    analysis->allocated = 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file analyze.h
+ *
+ * Working out which hooks could safely run in parallel. 'cuckoo --analyze' runs a
+ * chain serially, as usual, while repeatedly sampling /proc for the files each
+ * hook (and anything it started) has open, and whether it has them open for
+ * reading or writing. A hook depends on an earlier one if it reads a file the
+ * earlier one wrote, writes a file the earlier one read, or writes a file the
+ * earlier one also wrote. Hooks are given the data channel, as they would be
+ * normally, and a hook that passes anything on through it is taken to be
+ * depended on by every hook after it - which of them use a variable can't be
+ * seen from outside. Hooks are then grouped into stages: every hook in a stage
+ * depends only on hooks in earlier stages.
+ *
+ * Sampling can miss a file that's opened and closed between two samples, so
+ * the result is a proposal to review, not a proof.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_ANALYZE_H
+#define CUCKOO_ANALYZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hookdata.h"
+
+#define kAnalyzeInterval    5       /* milliseconds between samples */
+
+#define kAccessRead         (1 << 0)
+#define kAccessWrite        (1 << 1)
+#define kAccessAppend       (1 << 2)    /* every write was O_APPEND */
+
+typedef struct {
+    char *    path;
+    uint32_t  access;
+} tFileAccess;
+
+typedef struct {
+    char *        name;
+    int           result;
+    uint64_t      duration;
+    unsigned      samples;
+    tFileAccess * files;
+    size_t        count;
+    size_t        allocated;
+    char *        passed;       /* the keys it passed on through the data channel, if any */
+    int           stage;
+} tAnalyzedHook;
+
+typedef struct {
+    tAnalyzedHook * hooks;
+    size_t          count;
+    size_t          allocated;
+    char *          inherited[3];   /* what our stdin, stdout and stderr are, which every hook shares */
+    tHookVars       vars;           /* what the hooks so far have passed on */
+} tAnalysis;
+
+int  analyzeHook(    tAnalysis * analysis, const char * name, char * argv[], char * envp[] );
+void reportAnalysis( tAnalysis * analysis );
+void freeAnalysis(   tAnalysis * analysis );
+
+#endif /* CUCKOO_ANALYZE_H */
@@ -0,0 +1,272 @@
+/**
+ * @file canary.c
+ *
+ * Trying out a new version of a hook on real traffic, and comparing it with the
+ * current version.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "canary.h"
+
+/**
+ * @brief
+ * @param path
+ * @return true if this is a candidate version of another hook, rather than a hook itself
+ */
+bool isCanary( const char * path )
+{
+    size_t len       = strlen( path );
+    size_t suffixLen = strlen( kCanarySuffix );
+
+    return ( len > suffixLen && strcmp( path + len - suffixLen, kCanarySuffix ) == 0 );
+}
+
+/**
+ * @brief decide whether this invocation should involve the hook's candidate version
+ * @param hook the name of the current version
+ * @return
+ */
+tCanaryAction canaryChoose( const char * hook )
+{
+    static bool seeded = false;
+
+    const char * mode = getScopedConfigString( "hook", hook, "canary.mode", "shadow" );
+    if ( strcmp( mode, "off" ) == 0 )
+    {
+        return kCanaryNone;
+    }
+
+    long percent = getScopedConfigNumber( "hook", hook, "canary.percent", kCanaryPercent );
+
+    if ( !seeded )
+    {
+        srand48( nowNanoseconds( CLOCK_MONOTONIC ) ^ getpid() );
+        seeded = true;
+    }
+    if ( drand48() * 100.0 >= percent )
+    {
+        return kCanaryNone;
+    }
+
+    if ( strcmp( mode, "canary" ) == 0 )
+    {
+        return kCanaryReplace;
+    }
+    if ( strcmp( mode, "shadow" ) == 0 )
+    {
+        return kCanaryShadow;
+    }
+
+    syslog( LOG_WARNING, "%s: unknown canary.mode \'%s\'", hook, mode );
+    return kCanaryNone;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+static int compareChains( const void * a, const void * b )
+{
+    const tHistoryRecord * left  = a;
+    const tHistoryRecord * right = b;
+
+    return ( left->chain > right->chain ) - ( left->chain < right->chain );
+}
+
+static int compareRatios( const void * a, const void * b )
+{
+    double left  = *(const double *)a;
+    double right = *(const double *)b;
+
+    return ( left > right ) - ( left < right );
+}
+
+/**
+ * @brief print one row of the comparison - the runs of one version that have 'flags' (or all if 0)
+ */
+static void compareRow( const char * label, const tHistoryRecord * records, size_t count, uint32_t flags )
+{
+    uint64_t * durations = malloc( ( count + 1 ) * sizeof( uint64_t ) );
+    size_t     runs      = 0;
+    size_t     failures  = 0;
+
+    if ( durations == NULL )
+    {
+        return;
+    }
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( flags == 0 || ( records[i].flags & flags ) != 0 )
+        {
+            durations[ runs++ ] = records[i].duration;
+            failures += hookFailed( &records[i] );
+        }
+    }
+
+    if ( runs > 0 )
+    {
+        char p50[16], p90[16], max[16];
+
+        qsort( durations, runs, sizeof( uint64_t ), compareDurations );
+        printf( "    %-10s %6zu %6.1f%% %8s %8s %8s\n", label, runs, failures * 100.0 / runs,
+                formatDuration( historyPercentile( durations, runs, 50 ), p50, sizeof( p50 ) ),
+                formatDuration( historyPercentile( durations, runs, 90 ), p90, sizeof( p90 ) ),
+                formatDuration( durations[ runs - 1 ], max, sizeof( max ) ) );
+    }
+    free( durations );
+}
+
+/**
+ * @brief compare a candidate with the current version of a hook
+ * @param current the current version's records, or NULL if it hasn't run within the window
+ * @param candidate the candidate's records (both canary and shadow runs)
+ */
+static void compareHook( tHistoryRecord * current, size_t currentCount,
+                         const tHistoryRecord * candidate, size_t candidateCount )
+{
+    printf( "%s/%.*s:\n", candidate->target,
+            (int)( strlen( candidate->hook ) - strlen( kCanarySuffix ) ), candidate->hook );
+    printf( "    %-10s %6s %7s %8s %8s %8s\n", "version", "runs", "failed", "p50", "p90", "max" );
+
+    compareRow( "current", current, currentCount, 0 );
+    compareRow( "canary",  candidate, candidateCount, kHistoryCandidate );
+    compareRow( "shadow",  candidate, candidateCount, kHistoryShadow );
+
+    /* shadow runs saw exactly the same input as the current version did, so compare them pairwise */
+    double * ratios    = malloc( ( candidateCount + 1 ) * sizeof( double ) );
+    size_t   pairs     = 0;
+    size_t   disagreed = 0;
+
+    if ( ratios != NULL && current != NULL )
+    {
+        qsort( current, currentCount, sizeof( tHistoryRecord ), compareChains );
+        for ( size_t i = 0; i < candidateCount; ++i )
+        {
+            if ( ( candidate[i].flags & kHistoryShadow ) == 0 || candidate[i].chain == 0 )
+            {
+                continue;
+            }
+            const tHistoryRecord * match = bsearch( &candidate[i], current, currentCount,
+                                                    sizeof( tHistoryRecord ), compareChains );
+            if ( match != NULL && match->duration > 0 )
+            {
+                ratios[ pairs++ ] = (double)candidate[i].duration / match->duration;
+                disagreed += ( hookFailed( match ) != hookFailed( &candidate[i] ) );
+            }
+        }
+    }
+
+    if ( pairs > 0 )
+    {
+        qsort( ratios, pairs, sizeof( double ), compareRatios );
+        double median = ratios[ pairs / 2 ];
+        printf( "    paired over %zu shadow run%s: the candidate is %.0f%% %s (median), "
+                "and its exit status differed %zu time%s\n",
+                pairs, pairs == 1 ? "" : "s",
+                median <= 1.0 ? ( 1.0 - median ) * 100.0 : ( median - 1.0 ) * 100.0,
+                median <= 1.0 ? "faster" : "slower",
+                disagreed, disagreed == 1 ? "" : "s" );
+    }
+    free( ratios );
+}
+
+/**
+ * @brief implements 'cuckoo --compare [--window <duration>] [<target>]'
+ * @param argc
+ * @param argv the arguments following '--compare'
+ * @return exit code
+ */
+int showComparison( int argc, char * argv[] )
+{
+    long         window = 7 * 24 * 60 * 60;
+    const char * target = NULL;
+
+    for ( int i = 0; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "--window" ) == 0 && i + 1 < argc )
+        {
+            window = parseDuration( argv[++i], -1 );
+            if ( window < 0 )
+            {
+                return -1;
+            }
+        }
+        else if ( argv[i][0] != '-' && target == NULL )
+        {
+            target = argv[i];
+        }
+        else
+        {
+            reportError( "unexpected argument \'%s\'", argv[i] );
+            return -1;
+        }
+    }
+
+    tHistory history = { NULL, 0, 0 };
+    int result = loadHistory( &history, nowNanoseconds( CLOCK_REALTIME ) - (uint64_t)window * 1000000000, target );
+    if ( result != 0 )
+    {
+        return result;
+    }
+
+    /* grouped by target and hook, so a candidate's group follows its current version's */
+    qsort( history.records, history.count, sizeof( tHistoryRecord ), compareHistoryRecords );
+
+    int compared = 0;
+    for ( size_t start = 0, i = 1; i <= history.count; ++i )
+    {
+        const tHistoryRecord * first = &history.records[ start ];
+        if ( i < history.count
+          && strcmp( history.records[i].target, first->target ) == 0
+          && strcmp( history.records[i].hook,   first->hook )   == 0 )
+        {
+            continue;
+        }
+
+        if ( isCanary( first->hook ) )
+        {
+            /* find the current version's records */
+            size_t baseLen      = strlen( first->hook ) - strlen( kCanarySuffix );
+            size_t currentStart = 0;
+            size_t currentCount = 0;
+            for ( size_t j = 0; j < history.count; ++j )
+            {
+                const tHistoryRecord * record = &history.records[j];
+                if ( strcmp( record->target, first->target ) == 0
+                  && strlen( record->hook ) == baseLen
+                  && strncmp( record->hook, first->hook, baseLen ) == 0 )
+                {
+                    if ( currentCount++ == 0 )
+                    {
+                        currentStart = j;
+                    }
+                }
+            }
+
+            compareHook( currentCount > 0 ? &history.records[ currentStart ] : NULL, currentCount,
+                         first, i - start );
+            ++compared;
+        }
+        start = i;
+    }
+
+    if ( compared == 0 )
+    {
+        printf( "no candidate versions have run in the last %lds\n", window );
+    }
+
+    freeHistory( &history );
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file canary.h
+ *
+ * Trying out a new version of a hook on real traffic. A candidate version sits
+ * next to the hook it's meant to replace, with '.canary' appended to its name
+ * (e.g. '60-plex.canary' beside '60-plex'), and isn't run as a hook in its own right.
+ * For a configurable percentage of invocations, either:
+ *
+ *   shadow mode    the candidate runs alongside the current version, with its
+ *                  output discarded and its exit status ignored (the default)
+ *   canary mode    the candidate runs in place of the current version
+ *
+ * A shadow run gets the same arguments, but runs in a scratch working directory
+ * with CUCKOO_SHADOW set, so it's only safe for hooks with no side effects beyond
+ * their working directory (and those that check CUCKOO_SHADOW).
+ *
+ * Both are recorded in the history, and 'cuckoo --compare' reports how the
+ * candidate's latency and failure rate compare with the current version's.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_CANARY_H
+#define CUCKOO_CANARY_H
+
+#include <stdbool.h>
+
+#define kCanarySuffix       ".canary"
+#define kCanaryPercent      10
+#define kCanaryShadowEnvVar "CUCKOO_SHADOW"     /* set to the working directory it would have run in */
+
+typedef enum {
+    kCanaryNone,        /* run the current version, as usual */
+    kCanaryReplace,     /* run the candidate instead */
+    kCanaryShadow       /* run both */
+} tCanaryAction;
+
+bool          isCanary( const char * path );
+tCanaryAction canaryChoose( const char * hook );
+int           showComparison( int argc, char * argv[] );
+
+#endif /* CUCKOO_CANARY_H */
@@ -0,0 +1,335 @@
+/**
+ * @file config.c
+ *
+ * cuckoo's optional configuration file
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "report.h"
+#include "config.h"
+
+typedef struct sConfigEntry {
+    struct sConfigEntry * next;
+    char *                value;
+    char                  key[1];
+} tConfigEntry;
+
+static tConfigEntry * configHead;
+static bool           configLoaded;
+
+/**
+ * @brief trim leading and trailing whitespace in place
+ * @param string
+ * @return pointer to the first non-whitespace character
+ */
+static char * trim( char * string )
+{
+    while ( isspace( (unsigned char)*string ) )
+    {
+        ++string;
+    }
+
+    char * end = string + strlen( string );
+    while ( end > string && isspace( (unsigned char)end[-1] ) )
+    {
+        --end;
+    }
+    *end = '\0';
+
+    return string;
+}
+
+/**
+ * @brief
+ * @return where the configuration is read from
+ */
+const char * getConfigPath( void )
+{
+    const char * path = getenv( kConfigPathEnvVar );
+    return ( path == NULL || *path == '\0' ) ? kConfigPath : path;
+}
+
+/**
+ * @brief read the configuration file, if there is one. Safe to call more than once.
+ */
+void loadConfig( void )
+{
+    if ( configLoaded )
+    {
+        return;
+    }
+    configLoaded = true;
+
+    const char * path = getConfigPath();
+
+    FILE * file = fopen( path, "re" );
+    if ( file == NULL )
+    {
+        if ( errno != ENOENT )
+        {
+            reportErrno( "unable to read configuration from \'%s\'", path );
+        }
+        return;
+    }
+
+    tConfigEntry ** tail = &configHead;
+    char * line    = NULL;
+    size_t lineLen = 0;
+    int    lineNum = 0;
+
+    while ( getline( &line, &lineLen, file ) >= 0 )
+    {
+        ++lineNum;
+
+        char * comment = strchr( line, '#' );
+        if ( comment != NULL )
+        {
+            *comment = '\0';
+        }
+
+        char * key = trim( line );
+        if ( *key == '\0' )
+        {
+            continue;
+        }
+
+        char * equals = strchr( key, '=' );
+        if ( equals == NULL )
+        {
+            reportError( "%s:%d: expected \'key = value\'", path, lineNum );
+            continue;
+        }
+        *equals = '\0';
+        key = trim( key );
+        char * value = trim( equals + 1 );
+
+        size_t keyLen = strlen( key );
+        tConfigEntry * entry = calloc( 1, sizeof( tConfigEntry ) + keyLen + strlen( value ) + 1 );
+        if ( entry != NULL )
+        {
+            memcpy( entry->key, key, keyLen );
+            entry->value = &entry->key[ keyLen + 1 ];
+            strcpy( entry->value, value );
+
+            /* preserve the file's order, so a later duplicate overrides an earlier one */
+            *tail = entry;
+            tail  = &entry->next;
+        }
+    }
+
+    free( line );
+    fclose( file );
+}
+
+/**
+ * @brief release everything loadConfig() allocated
+ */
+void freeConfig( void )
+{
+    tConfigEntry * entry = configHead;
+    while ( entry != NULL )
+    {
+        tConfigEntry * f = entry;
+        entry = entry->next;
+        free( f );
+    }
+    configHead   = NULL;
+    configLoaded = false;
+}
+
+/**
+ * @brief
+ * @param key
+ * @param defaultValue
+ * @return the value of the last line setting 'key', or defaultValue if there isn't one
+ */
+const char * getConfigString( const char * key, const char * defaultValue )
+{
+    const char * result = defaultValue;
+
+    loadConfig();
+
+    for ( tConfigEntry * entry = configHead; entry != NULL; entry = entry->next )
+    {
+        if ( strcmp( entry->key, key ) == 0 )
+        {
+            result = entry->value;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief
+ * @param key
+ * @param defaultValue
+ * @return
+ */
+long getConfigNumber( const char * key, long defaultValue )
+{
+    long result = defaultValue;
+
+    const char * value = getConfigString( key, NULL );
+    if ( value != NULL )
+    {
+        char * end;
+        errno = 0;
+        long number = strtol( value, &end, 0 );
+        if ( errno != 0 || end == value || *trim( end ) != '\0' )
+        {
+            reportError( "\'%s\' should be a number, not \'%s\'", key, value );
+        }
+        else
+        {
+            result = number;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief
+ * @param key
+ * @param defaultValue
+ * @return
+ */
+bool getConfigBool( const char * key, bool defaultValue )
+{
+    bool result = defaultValue;
+
+    const char * value = getConfigString( key, NULL );
+    if ( value != NULL )
+    {
+        if ( strcasecmp( value, "yes"  ) == 0
+          || strcasecmp( value, "true" ) == 0
+          || strcasecmp( value, "on"   ) == 0
+          || strcmp(     value, "1"    ) == 0 )
+        {
+            result = true;
+        }
+        else if ( strcasecmp( value, "no"    ) == 0
+               || strcasecmp( value, "false" ) == 0
+               || strcasecmp( value, "off"   ) == 0
+               || strcmp(     value, "0"     ) == 0 )
+        {
+            result = false;
+        }
+        else
+        {
+            reportError( "\'%s\' should be yes or no, not \'%s\'", key, value );
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief
+ * @param scope e.g. "target" or "hook"
+ * @param name the name of the target or hook
+ * @param key
+ * @return '<scope>.<name>.<key>' if the configuration sets it, otherwise NULL (caller should free)
+ */
+static char * scopedKeyIfSet( const char * scope, const char * name, const char * key )
+{
+    char * result = NULL;
+
+    if ( name != NULL && asprintf( &result, "%s.%s.%s", scope, name, key ) >= 0 )
+    {
+        if ( getConfigString( result, NULL ) == NULL )
+        {
+            free( result );
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief look up '<scope>.<name>.<key>', falling back to plain '<key>'
+ * @param scope e.g. "target" or "hook"
+ * @param name the name of the target or hook
+ * @param key
+ * @param defaultValue
+ * @return
+ */
+const char * getScopedConfigString( const char * scope, const char * name,
+                                    const char * key, const char * defaultValue )
+{
+    char * scopedKey = scopedKeyIfSet( scope, name, key );
+    const char * result = getConfigString( scopedKey != NULL ? scopedKey : key, defaultValue );
+    free( scopedKey );
+
+    return result;
+}
+
+long getScopedConfigNumber( const char * scope, const char * name,
+                            const char * key, long defaultValue )
+{
+    char * scopedKey = scopedKeyIfSet( scope, name, key );
+    long result = getConfigNumber( scopedKey != NULL ? scopedKey : key, defaultValue );
+    free( scopedKey );
+
+    return result;
+}
+
+bool getScopedConfigBool( const char * scope, const char * name,
+                          const char * key, bool defaultValue )
+{
+    char * scopedKey = scopedKeyIfSet( scope, name, key );
+    bool result = getConfigBool( scopedKey != NULL ? scopedKey : key, defaultValue );
+    free( scopedKey );
+
+    return result;
+}
+
+/**
+ * @brief parse a duration such as '90', '90s', '15m', '12h' or '7d'
+ * @param value
+ * @param defaultValue
+ * @return the duration in seconds, or defaultValue if value is NULL or malformed
+ */
+long parseDuration( const char * value, long defaultValue )
+{
+    if ( value == NULL )
+    {
+        return defaultValue;
+    }
+
+    char * end;
+    errno = 0;
+    long result = strtol( value, &end, 10 );
+    if ( errno != 0 || end == value || result < 0 )
+    {
+        reportError( "\'%s\' isn't a valid duration", value );
+        return defaultValue;
+    }
+
+    switch ( *end )
+    {
+    case '\0':
+    case 's': break;
+    case 'm': result *= 60;           break;
+    case 'h': result *= 60 * 60;      break;
+    case 'd': result *= 24 * 60 * 60; break;
+
+    default:
+        reportError( "\'%s\' isn't a valid duration", value );
+        return defaultValue;
+    }
+
+    return result;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file config.h
+ *
+ * cuckoo's optional configuration file, /etc/cuckoo/cuckoo.conf by default.
+ *
+ * The file is a list of 'key = value' lines. Blank lines and anything following
+ * a '#' are ignored. Settings that can be overridden for a particular target or
+ * hook are looked up as '<scope>.<name>.<key>' before falling back to '<key>',
+ * e.g. 'hook.70-mark.timeout' before 'timeout'. Only the queue's 'priority',
+ * 'priority.<class>' and 'queue.weight' are scoped by target; the rest are global.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_CONFIG_H
+#define CUCKOO_CONFIG_H
+
+#include <stdbool.h>
+
+#define kConfigPath         "/etc/cuckoo/cuckoo.conf"
+#define kConfigPathEnvVar   "CUCKOO_CONFIG"
+
+const char * getConfigPath( void );
+void         loadConfig( void );
+void         freeConfig( void );
+
+const char * getConfigString( const char * key, const char * defaultValue );
+long         getConfigNumber( const char * key, long defaultValue );
+bool         getConfigBool(   const char * key, bool defaultValue );
+
+const char * getScopedConfigString( const char * scope, const char * name,
+                                    const char * key, const char * defaultValue );
+long         getScopedConfigNumber( const char * scope, const char * name,
+                                    const char * key, long defaultValue );
+bool         getScopedConfigBool(   const char * scope, const char * name,
+                                    const char * key, bool defaultValue );
+
+long         parseDuration( const char * value, long defaultValue );
+
+#endif /* CUCKOO_CONFIG_H */
@@ -0,0 +1,346 @@
+/**
+ * @file cuckoo-shim.c
+ *
+ * What the impersonating symlink points at. It's exec'd every time the target is,
+ * so it's statically linked (no stdio, no dynamic loader) and only knows how to
+ * run a plan the full runner has already written, appending to the history as it
+ * goes. Anything else is handed off to the runner, 'cuckoo', which is expected
+ * beside it.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdio.h>             /* rename() only - no stdio streams are used */
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "config.h"
+#include "history.h"
+#include "shim.h"
+
+static uint8_t planBuffer[ kShimPlanMaxSize ];
+static int     historyFd = -1;
+
+/**
+ * @brief write a message to stderr, without pulling in stdio
+ */
+static void complain( const char * message, const char * detail )
+{
+    write( STDERR_FILENO, kShimName ": ", sizeof( kShimName ": " ) - 1 );
+    write( STDERR_FILENO, message, strlen( message ) );
+    write( STDERR_FILENO, detail, strlen( detail ) );
+    write( STDERR_FILENO, "\n", 1 );
+}
+
+/**
+ * @brief exec the full runner in our place. Only returns if that fails.
+ * @param argv as we were given them - argv[0] tells the runner which target it's running
+ * @param envp
+ * @return exit code
+ */
+static int handOff( char * argv[], char * envp[] )
+{
+    char path[ PATH_MAX ];
+
+    ssize_t len = readlink( "/proc/self/exe", path, sizeof( path ) - sizeof( kRunnerName ) - 1 );
+    if ( len > 0 )
+    {
+        path[ len ] = '\0';
+        char * slash = strrchr( path, '/' );
+        strcpy( ( slash != NULL ) ? slash + 1 : path, kRunnerName );
+
+        /* invoked as 'cuckoo-shim' rather than through a symlink - a command for the runner */
+        const char * name = strrchr( argv[0], '/' );
+        if ( strcmp( ( name != NULL ) ? name + 1 : argv[0], kShimName ) == 0 )
+        {
+            argv[0] = path;
+        }
+        execve( path, argv, envp );
+    }
+
+    complain( "unable to run ", kRunnerName );
+    return 127;
+}
+
+static bool stampMatches( const char * path, const tShimStamp * stamp )
+{
+    struct stat info;
+
+    if ( stat( path, &info ) != 0 )
+    {
+        return ( stamp->ino == 0 );
+    }
+    return ( stamp->dev  == (uint64_t)info.st_dev
+          && stamp->ino  == (uint64_t)info.st_ino
+          && stamp->sec  == (int64_t)info.st_ctim.tv_sec
+          && stamp->nsec == (int64_t)info.st_ctim.tv_nsec );
+}
+
+/**
+ * @brief load the target's plan, if it has one that's still current
+ * @param installPath the symlink we were invoked through (absolute, or relative to the cwd)
+ * @return NULL if there's no plan we can trust
+ */
+static const tShimPlan * loadPlan( const char * installPath )
+{
+    char path[ PATH_MAX ];
+
+    /* '/dir/target' -> '/dir/.target.plan' */
+    const char * name   = strrchr( installPath, '/' ) + 1;
+    size_t       dirLen = name - installPath;
+    if ( dirLen + 1 + strlen( name ) + sizeof( kShimPlanSuffix ) > sizeof( path ) )
+    {
+        return NULL;
+    }
+    memcpy( path, installPath, dirLen );
+    path[ dirLen ] = '.';
+    strcpy( stpcpy( &path[ dirLen + 1 ], name ), kShimPlanSuffix );
+
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return NULL;
+    }
+    ssize_t len = read( fd, planBuffer, sizeof( planBuffer ) );
+    close( fd );
+
+    const tShimPlan * plan = (const tShimPlan *)planBuffer;
+    if ( len < (ssize_t)sizeof( tShimPlan )
+      || plan->magic != kShimPlanMagic || plan->version != kShimPlanVersion
+      || plan->size != (uint32_t)len || planBuffer[ len - 1 ] != '\0'
+      || plan->count * ( sizeof( tShimStamp ) + 1 ) >= len - sizeof( tShimPlan ) )
+    {
+        return NULL;
+    }
+
+    const tShimStamp * stamps = (const tShimStamp *)( plan + 1 );
+    const char *       next   = (const char *)stamps + plan->count * ( sizeof( tShimStamp ) + 1 );
+
+    /* the same configuration file as the runner read, unchanged? */
+    const char * configPath = getenv( kConfigPathEnvVar );
+    if ( configPath == NULL || *configPath == '\0' )
+    {
+        configPath = kConfigPath;
+    }
+    if ( strcmp( next, configPath ) != 0 || !stampMatches( next, &plan->config ) )
+    {
+        return NULL;
+    }
+    next += strlen( next ) + 1;
+
+    /* no hooks added or removed? */
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( !stampMatches( next, &plan->dirs[i] ) )
+        {
+            return NULL;
+        }
+        next += strlen( next ) + 1;
+    }
+    /* (the history file) */
+    next += strlen( next ) + 1;
+
+    /* and none replaced or changed? */
+    for ( uint32_t i = 0; i < plan->count; ++i )
+    {
+        if ( next >= (const char *)&planBuffer[ len ] || !stampMatches( next, &stamps[i] ) )
+        {
+            return NULL;
+        }
+        next += strlen( next ) + 1;
+    }
+    return plan;
+}
+
+static uint64_t nanoseconds( clockid_t clock )
+{
+    struct timespec now;
+    clock_gettime( clock, &now );
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief open the history file, rotating it first if it's full - as history.c does
+ * @param path
+ * @param maxSize
+ */
+static void openHistory( const char * path, int64_t maxSize )
+{
+    char        rotated[ PATH_MAX ];
+    struct stat fdStat, pathStat;
+
+    historyFd = open( path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644 );
+    if ( historyFd < 0 || maxSize <= 0
+      || fstat( historyFd, &fdStat ) != 0
+      || fdStat.st_size + (off_t)sizeof( tHistoryRecord ) <= maxSize
+      || strlen( path ) + 3 > sizeof( rotated ) )
+    {
+        return;
+    }
+
+    if ( flock( historyFd, LOCK_EX ) == 0 )
+    {
+        if ( stat( path, &pathStat ) == 0 && pathStat.st_dev == fdStat.st_dev && pathStat.st_ino == fdStat.st_ino )
+        {
+            strcpy( stpcpy( rotated, path ), ".1" );
+            rename( path, rotated );
+        }
+        flock( historyFd, LOCK_UN );
+    }
+    close( historyFd );
+    historyFd = open( path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644 );
+}
+
+/**
+ * @brief run one hook, with only the runner's history bookkeeping
+ * @param argv argv[0] is the hook's path
+ * @param envp
+ * @param flags kShim* flags
+ * @param record if not NULL, filled in as the runner would
+ * @return exit code, with the same conventions as the runner's
+ */
+static int runHook( char * argv[], char * envp[], uint8_t flags, tHistoryRecord * record )
+{
+    int           status    = 0;
+    volatile int  execErrno = 0;
+    struct rusage usage;
+
+    memset( &usage, 0, sizeof( usage ) );
+    uint64_t started = nanoseconds( CLOCK_MONOTONIC );
+    if ( record != NULL )
+    {
+        record->started = nanoseconds( CLOCK_REALTIME );
+    }
+
+    pid_t pid = vfork();
+    switch ( pid )
+    {
+    case -1:
+        complain( "unable to launch ", argv[0] );
+        status = W_EXITCODE( 127, 0 );
+        break;
+
+    case 0:
+        if ( flags & kShimCloseInherited )
+        {
+            syscall( SYS_close_range, STDERR_FILENO + 1, ~0U, 0 );
+        }
+        execve( argv[0], argv, envp );
+        execErrno = errno;
+        _exit( 127 );
+
+    default:
+        while ( wait4( pid, &status, 0, &usage ) < 0 )
+        {
+            if ( errno != EINTR )
+            {
+                status = W_EXITCODE( 127, 0 );
+                break;
+            }
+        }
+        break;
+    }
+
+    if ( record != NULL )
+    {
+        record->duration = nanoseconds( CLOCK_MONOTONIC ) - started;
+        record->pid      = pid;
+        record->status   = status;
+        record->userMs   = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+        record->systemMs = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+        record->maxRssKb = usage.ru_maxrss;
+        if ( execErrno != 0 || pid < 0 )
+        {
+            record->flags |= kHistoryExecFailed;
+        }
+    }
+
+    if ( WIFSIGNALED( status ) )
+    {
+        return 128 + WTERMSIG( status );
+    }
+    return WEXITSTATUS( status );
+}
+
+int main( int argc, char * argv[], char * envp[] )
+{
+    (void)argc;
+
+    /* without a slash, we were found on the PATH - leave the searching to the runner */
+    const tShimPlan * plan = ( strchr( argv[0], '/' ) != NULL ) ? loadPlan( argv[0] ) : NULL;
+    if ( plan == NULL )
+    {
+        return handOff( argv, envp );
+    }
+
+    const uint8_t * flags = (const uint8_t *)( (const tShimStamp *)( plan + 1 ) + plan->count );
+    char *          next  = (char *)( flags + plan->count );
+    for ( int i = 0; i < 3; ++i )
+    {
+        next += strlen( next ) + 1;
+    }
+    const char * historyPath = next;
+    next += strlen( next ) + 1;
+
+    /* '/dir/target' -> 'target' */
+    const char * target = strrchr( argv[0], '/' ) + 1;
+    uint64_t     chain  = nanoseconds( CLOCK_REALTIME ) ^ ( (uint64_t)getpid() << 40 );
+    if ( *historyPath != '\0' )
+    {
+        openHistory( historyPath, plan->historyMaxSize );
+    }
+
+    int result = 0;
+    for ( uint32_t i = 0; i < plan->count; ++i )
+    {
+        argv[0] = next;
+        next += strlen( next ) + 1;
+
+        if ( i + 1 == plan->count && result == 0 && historyFd < 0 )
+        {
+            /* the last hook, nothing has failed, and there's nothing to record afterwards - so
+             * its exit code is ours. Become it, rather than waiting around for it. */
+            if ( flags[i] & kShimCloseInherited )
+            {
+                syscall( SYS_close_range, STDERR_FILENO + 1, ~0U, 0 );
+            }
+            execve( argv[0], argv, envp );
+            return 127;
+        }
+
+        tHistoryRecord record;
+        memset( &record, 0, sizeof( record ) );
+        record.magic = kHistoryMagic;
+        record.size  = sizeof( record );
+        record.flags = ( i == 0 ) ? kHistoryChainStart : 0;
+        record.chain = chain;
+        strncpy( record.target, target, sizeof( record.target ) - 1 );
+        const char * name = strrchr( argv[0], '/' );
+        strncpy( record.hook, ( name != NULL ) ? name + 1 : argv[0], sizeof( record.hook ) - 1 );
+
+        int res = runHook( argv, envp, flags[i], historyFd >= 0 ? &record : NULL );
+        if ( historyFd >= 0 )
+        {
+            /* a single write() of a small record to an O_APPEND file won't interleave with other writers */
+            write( historyFd, &record, sizeof( record ) );
+        }
+        if ( result == 0 && res != 0 )
+        {
+            result = res;
+        }
+    }
+    return result;
+}
@@ -23,7 +23,28 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <ftw.h>
-
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "queue.h"
+#include "metrics.h"
+#include "progress.h"
+#include "verify.h"
+#include "fdpolicy.h"
+#include "canary.h"
+#include "analyze.h"
+#include "hookdata.h"
+#include "spool.h"
+#include "paths.h"
+#include "shim.h"
+#include "libcuckoo.h"
 
 const char * usageInstructions =
 {
@@ -31,6 +52,35 @@ const char * usageInstructions =
     "Usage: cuckoo <pathname>\n"
     "  Creates a subdirectory and moves the executable found at <pathname> into it.\n"
     "  A symlink is then created at <pathname> that points to this executable.\n"
+    "\n"
+    "       cuckoo --verify [--user <name>] [--smoke] <pathname>\n"
+    "  Checks every hook of the executable at <pathname>: its '#!' interpreter or\n"
+    "  dynamic loader, and its permissions for the user the hooks will run as.\n"
+    "  Broken hooks are skipped until they change. --smoke also tries to run each\n"
+    "  one (with --version). This check is also done by every install.\n"
+    "\n"
+    "       cuckoo --stats [--window <duration>] [<target>]\n"
+    "  Reports latency percentiles, failure rates and trends for each hook, from\n"
+    "  the history recorded over the window (default 7d, e.g. 90m, 12h, 30d).\n"
+    "\n"
+    "       cuckoo --status\n"
+    "  Lists the hooks that are running, with their progress and heartbeats.\n"
+    "\n"
+    "       cuckoo --metrics [--window <duration>]\n"
+    "  Prints hook latency and failures over the window (default 1h), and the\n"
+    "  state of the queue and the spool, in the Prometheus text exposition format.\n"
+    "\n"
+    "       cuckoo --compare [--window <duration>] [<target>]\n"
+    "  Compares the latency and failure rate of each candidate ('.canary') hook\n"
+    "  with its current version, over the window (default 7d).\n"
+    "\n"
+    "       cuckoo --analyze <pathname> [<argument>...]\n"
+    "  Runs the hooks serially with the arguments given, watching which files\n"
+    "  each one reads and writes, and proposes which could run in parallel.\n"
+    "\n"
+    "       cuckoo --drain-spool [--force]\n"
+    "  Runs the jobs that windowed hooks have spooled, in the order they were\n"
+    "  submitted, while within the maintenance window (or regardless, with --force).\n"
 #if 0
     "  When this executable is invoked through the symlink, it goes through the\n"
     "  subdirectory in alphabetical order, executing every executable it finds\n"
@@ -43,58 +93,6 @@ const char * usageInstructions =
     "More information can be found at https://channels-dvr-goodies.github.io/cuckoo\n"
 };
 
-#define debugf( ... ) DebugF_( __func__, __LINE__, __VA_ARGS__ )
-
-static void DebugF_( const char * function, const int line, const char * format, ... )
-{
-	va_list args;
-
-	va_start( args, format );
-
-	vfprintf( stderr, format, args );
-	fprintf(  stderr, " (%s() at line %d)\n", function, line );
-
-	va_end( args );
-}
-
-#define reportError( ... ) ReportError_( __func__, __LINE__, __VA_ARGS__ )
-
-static int ReportError_( const char * function, const int line, const char * format, ... )
-{
-    va_list args;
-
-    int savedErrno = errno;
-
-    va_start( args, format );
-
-    fprintf(  stderr, "err: " );
-    vfprintf( stderr, format, args );
-    fprintf(  stderr, " (%s() at line %d)\n", function, line );
-
-    va_end( args );
-
-    return savedErrno;
-}
-
-#define reportErrno( ... ) ReportErrno_( __func__, __LINE__, __VA_ARGS__ )
-
-static int ReportErrno_( const char * function, const int line, const char * format, ... )
-{
-	va_list args;
-
-	int savedErrno = errno;
-
-	va_start( args, format );
-
-	fprintf( stderr, "err: " );
-	vfprintf( stderr, format, args );
-	fprintf( stderr, " (%d: %s) in %s() at line %d\n", savedErrno, strerror( savedErrno ), function, line );
-
-	va_end( args );
-
-	return savedErrno;
-}
-
 /**
  * @brief
  * @param format
@@ -112,294 +110,96 @@ void usage( const char * format, ... )
 }
 
 /**
- * @brief
- * @param path
- * @return
- */
-const char * absolutePath( const char * path )
-{
-    char * result = NULL;
-    struct stat pathInfo;
-    char * dir;
-    char * directory;
-    char * filename;
-
-    if( lstat( path, &pathInfo ) != 0 )
-    {
-        reportErrno( "unable to get information about \'%s\'", path );
-        return NULL;
-    }
-
-    switch ( pathInfo.st_mode & S_IFMT )
-    {
-    case S_IFLNK:
-        {
-            char * copy = strdup( path );
-            if ( copy != NULL )
-            {
-                filename = strrchr( copy, '/' );
-                if ( filename == NULL )
-                {
-                    /* no slash, just the filename */
-                    dir = "./";
-                    filename = copy;
-                }
-                else
-                {
-                    dir = copy;
-                    *filename++ = '\0';
-                }
-
-                directory = realpath( dir, NULL);
-                if ( directory != NULL )
-                {
-                    asprintf( &result, "%s/%s", directory, filename );
-                    free( directory );
-                }
-
-                free( copy );
-            }
-
-        }
-        break;
-
-    case S_IFREG:
-    case S_IFDIR:
-        result = realpath( path, NULL );
-        break;
-
-    default:
-        /* whatever it is, we don't support it */
-        reportError( "\'%s\' isn't supported", path );
-        result = NULL;
-        break;
-    }
-
-    return result;
-}
-
-/**
- * @brief
- * @param path
- * @return
+ * @brief check the hooks of an installed target, and record the verdicts in its manifest. Then
+ *        plan its chain with them, which points its symlink at the shim if that can run it.
+ * @param installPath absolute path of the hooked executable
+ * @param scriptsDir
+ * @param user who the hooks run as, or NULL to infer it
+ * @param smoke also try running each hook
+ * @return exit code
  */
-const char * basenamedup( const char * path )
+static int verifyTarget( const char * installPath, const char * scriptsDir, const char * user, bool smoke )
 {
-    char * result = NULL;
+    int result = -1;
 
-    char * lastSlash = strrchr( path,'/' );
-    if ( lastSlash != NULL)
-    {
-        result = strdup( lastSlash + 1 );
-    }
-    else
+    const char * commonDir = getCommonDir( installPath );
+    if ( commonDir != NULL )
     {
-        result = strdup( path );
+        result = verifyHooks( installPath, scriptsDir, commonDir, user, smoke );
+        free( (void *)commonDir );
+        cuckooRelease( cuckooPlan( installPath ) );
     }
-
     return result;
 }
 
 /**
- * @brief creates all directories of a path that are missing (like mkdir -p)
- * @param path
- * @return
+ * @brief implements 'cuckoo --verify [--user <name>] [--smoke] <pathname>'
+ * @param argc
+ * @param argv the arguments following '--verify'
+ * @return exit code
  */
-static int mkDirRecurse( const char * path )
+int verify( int argc, char * argv[] )
 {
-    int result;
-    struct stat   dirStat;
+    int          result = -1;
+    const char * user   = NULL;
+    const char * target = NULL;
+    bool         smoke  = false;
 
-    if ( stat( path, &dirStat ) != 0 )
+    for ( int i = 0; i < argc; ++i )
     {
-        if (errno == ENOENT)
+        if ( strcmp( argv[i], "--user" ) == 0 && i + 1 < argc )
         {
-            char * parent = strdup( path );
-            result = mkDirRecurse( dirname( parent ) );
-            free( parent );
-            if (result == 0)
-            {
-                result = mkdir( path, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
-                if ( result != 0 )
-                {
-                    reportErrno( "unable to create directory \'%s\'", path );
-                }
-            }
-            return result;
+            user = argv[++i];
         }
-        else
+        else if ( strcmp( argv[i], "--smoke" ) == 0 )
         {
-            return reportErrno( "unable to get information about \'%s\'", path );
+            smoke = true;
         }
-    }
-    return 0;
-}
-
-/**
- * @brief
- * @param path
- * @return
- */
-const char * makeDirectory( const char * path )
-{
-    const char *  result = NULL;
-    struct stat   dirStat;
-
-    /* does the script directory already exist? */
-    if ( stat( path, &dirStat ) == 0 )
-    {
-        if ( S_ISDIR(dirStat.st_mode ) )
+        else if ( argv[i][0] != '-' && target == NULL )
         {
-            result = path;
+            target = argv[i];
         }
         else
         {
-            /* something there already, but it's not a directory */
-            reportErrno( "\'%s\' exists, but is not a directory", path );
-        }
-    }
-    else
-    {
-        /* stat() failed */
-        if ( errno != ENOENT )
-        {
-            /* report anything other than the expected 'not found' */
-            reportErrno( "unable to get info about \'%s\'", path );
-        }
-        else if ( mkDirRecurse( path ) == 0 )
-        {
-            result = path;
+            usage( "unexpected argument \'%s\'\n", argv[i] );
+            return -1;
         }
     }
-    return strdup( result );
-}
-
-/**
- * @brief
- * @param absPathFrom
- * @param absPathTo
- * @return
- */
-const char * makeSymlink( const char * absPathFrom, const char * absPathTo )
-{
-    const char *  result = NULL;
-    struct stat   dirStat;
 
-    debugf("from: \'%s\' to: \'%s\'", absPathFrom, absPathTo );
-    /* does the link to the script directory already exist? */
-    if ( stat( absPathFrom, &dirStat ) == 0 )
+    if ( target == NULL )
     {
-        if ( S_ISLNK( dirStat.st_mode ) )
-        {
-            /* a symlink exists, we're good. */
-            result = absPathFrom;
-        }
-        else
-        {
-            /* something there already, but it's not a symbolic link */
-            reportErrno( "\'%s\' exists, but is not a symbolic link", absPathFrom );
-        }
-    }
-    else
-    {
-        /* stat() failed */
-        if ( errno != ENOENT )
-        {
-            /* report anything other than the expected 'not found' */
-            reportErrno( "unable to get info about \'%s\'", absPathFrom );
-        }
-        else if ( symlink( absPathFrom, absPathTo ) != 0 )
-        {
-            reportErrno( "failed to create a symbolic link from \'%s\' to \'%s\'", absPathFrom, absPathTo );
-        }
-        else
-        {
-            /* successfully created the symlink */
-            result = absPathFrom;
-        }
+        usage( "please provide the path of the hooked executable to verify\n" );
+        return -1;
     }
-    return result;
-}
 
-/**
- * @brief
- * @param scriptsDir
- * @return
- */
-const char * getScriptsDir( const char * absPath )
-{
-    const char *  result = NULL;
-
-    char * dir = strdup( absPath );
-    if ( dir != NULL )
+    const char * installPath = absolutePath( target );
+    if ( installPath != NULL )
     {
-        char * base = strrchr( dir, '/' );
-        if ( base != NULL)
+        const char * scriptsDir = getScriptsDir( installPath );
+        if ( scriptsDir != NULL )
         {
-            *base++ = '\0';
-
-            char * scriptsDir = NULL;
-            asprintf( &scriptsDir, "%s/.%s.d", dir, base );
-            if ( scriptsDir != NULL )
-            {
-                result = makeDirectory( scriptsDir );
-                free( scriptsDir );
-            }
+            result = verifyTarget( installPath, scriptsDir, user, smoke );
+            free( (void *)scriptsDir );
         }
-        free( dir );
+        free( (void *)installPath );
     }
-
     return result;
 }
 
 /**
- * @brief
+ * @brief verify the hooks after an install. Broken hooks are reported, but don't fail the
+ *        install - it worked, and the broken hooks will be skipped until they're fixed.
+ * @param installPath
  * @param scriptsDir
- * @return
  */
-const char * getCommonDir( const char * absPath )
+static void warnIfBroken( const char * installPath, const char * scriptsDir )
 {
-    const char *  result = NULL;
-
-    char * dir = strdup( absPath );
-    if ( dir != NULL )
+    if ( verifyTarget( installPath, scriptsDir, NULL, false ) != 0 )
     {
-        char * base = strrchr( dir, '/' );
-        if ( base != NULL)
-        {
-            *base++ = '\0';
-
-            char * commonDir = NULL;
-            asprintf( &commonDir, "/etc/cuckoo/%s", base );
-            if ( commonDir != NULL )
-            {
-                result = makeDirectory( commonDir );
-                free( commonDir );
-            }
-        }
-        free( dir );
+        printf( "warning: the install succeeded, but verifying \'%s\' found problems\n", installPath );
     }
-
-    return result;
 }
 
-/**
- * @brief get the full path to ourselves
- * @return absolute path to the executable used to create this process (caller should free)
- */
-const char * getPathToSelf( void )
-{
-    /* figure out the absolute path to this executable */
-    char temp[PATH_MAX + 1];
-    temp[0] = '\0';
-    int len = readlink( "/proc/self/exe", temp, sizeof(temp));
-    if ( len >= 0 )
-    {
-        temp[len] = '\0';
-    }
-    return strdup( temp );
-};
-
 /**
  * @brief do the shuffle to move the original executable into the .d folder, and creating the symlink.
  * @param app the target executable to hook
@@ -434,7 +234,7 @@ int install( char * argv[] )
                 case S_IFLNK:
                     /* we've been here already? */
                     printf( "nothing to do - \'%s\' is already a symlink\n", installPath );
-                    result = 0;
+                    warnIfBroken( installPath, scriptsDir );
                     break;
 
                 case S_IFREG:
@@ -446,36 +246,44 @@ int install( char * argv[] )
                     }
                     else
                     {
-                        /* move the executable into the scripts dir and rename it so it sorts first */
-                        char * targetPath;
+                        /* move the executable into the scripts dir and rename it so it sorts first,
+                         * and replace it with a symlink to ourselves to pretend to be it. The symlink
+                         * is renamed over the original, so anything executing it meanwhile (e.g. the
+                         * DVR, right after updating itself) finds one or the other, never neither. */
+                        char * targetPath = NULL;
+                        char * newPath    = NULL;
                         asprintf( &targetPath, "%s/50-%s", scriptsDir, filename );
-                        if (targetPath != NULL)
+                        asprintf( &newPath, "%s.cuckoo", installPath );
+                        const char * execPath = getPathToSelf();
+                        if ( targetPath != NULL && newPath != NULL && execPath != NULL )
                         {
-                            if ( rename( installPath, targetPath ) != 0 )
+                            unlink( newPath );
+                            if ( symlink( execPath, newPath ) != 0 )
+                            {
+                                result = reportErrno( "unable to symlink \'%s\' to \'%s\'", newPath, execPath );
+                            }
+                            else if ( link( installPath, targetPath ) != 0
+                                   && rename( installPath, targetPath ) != 0 )
                             {
+                                /* can't hard link it (e.g. not permitted), so moving it was the next best thing */
                                 result = reportErrno( "failed to move \'%s\' to \'%s\'", installPath, scriptsDir );
+                                unlink( newPath );
+                            }
+                            else if ( rename( newPath, installPath ) != 0 )
+                            {
+                                result = reportErrno( "unable to replace \'%s\' with a symlink", installPath );
                             }
                             else
                             {
-                                /* create a symlink to ourselves to pretend to be the executable we just moved */
-                                const char * execPath = getPathToSelf();
-                                if ( execPath != NULL )
-                                {
-                                    if ( symlink( execPath, installPath ) != 0 )
-                                    {
-                                        result = reportErrno( "unable to symlink \'%s\' to \'%s\'", installPath, execPath );
-                                    }
-                                    else
-                                    {
-                                        printf( "Successfully Installed \'%s\' to \'%s\'.\n"
-                                                "The script directory can be found at \'%s\'\n",
-                                                execPath, installPath, scriptsDir );
-                                    }
-                                    free((void *)execPath );
-                                }
+                                printf( "Successfully Installed \'%s\' to \'%s\'.\n"
+                                        "The script directory can be found at \'%s\'\n",
+                                        execPath, installPath, scriptsDir );
+                                warnIfBroken( installPath, scriptsDir );
                             }
-                            free( targetPath );
                         }
+                        free( (void *)execPath );
+                        free( newPath );
+                        free( targetPath );
                     }
                     break;
                 }
@@ -490,176 +298,67 @@ int install( char * argv[] )
 }
 
 /**
- * @brief launches an executable.
- * @param argv array of arguments. argv[0] is path to executable. terminated by null pointer.
- * @param envp array of environment values, terminated by null pointer.
- * @return exit code from the launched process.
- */
-int launch( char * argv[], char * envp[] )
-{
-    int result = 0;
-    int status;
-
-    /* `vfork()` is slightly more efficient than `fork()` for this common scenario,
-     * where the child immediately calls one of the variants of `execve()`, so it
-     * doesn't need to create a copy of the page tables, only to blow them away
-     * immediately by calling `execve()`
-     */
-    int pid = vfork();
-    switch ( pid )
-    {
-    case -1: /* fork failed */
-        syslog( LOG_ERR, "err: unable to launch \'%s\'", argv[0] );
-        result = errno;
-        break;
-
-    case 0: /* this execution thread is the child */
-        execve( argv[0], argv, envp );
-        break; /* execve should never return... */
-
-    default: /* this execution thread is the parent - 'pid' is of the child */
-        waitpid( pid, &status, 0 );
-        if ( WIFEXITED( status ) )
-        {
-            result = WEXITSTATUS( status );
-        }
-        break;
-    }
-    return result;
-}
-
-typedef struct sExecutable {
-    struct sExecutable *  next;
-    unsigned short        nameOffset;
-    char                  path[1];
-} tExecutable;
-
-tExecutable * executableHead;
-
-/**
- * @brief
- * @param path
- * @param info
- * @param entryType
- * @param ftw
+ * @brief we were invoked through a symlink - run the target's hooks
+ * @param argv
+ * @param envp
  * @return
  */
-int forEachEntry( const char * path, const struct stat *info, int entryType, struct FTW * ftw )
+int invoke( char * argv[], char * envp[] )
 {
-    int result = FTW_CONTINUE;
+    int result = 0;
 
-    // reportErrno("level: %d, path: %s\n",  ftw->level, path );
-    switch (entryType)
+    tCuckooPlan * plan = cuckooPlan( argv[0] );
+    if ( plan != NULL )
     {
-    case FTW_D:
-    case FTW_DP:
-    case FTW_DNR:
-        if ( ftw->level > 0 )
-        {
-            /* for any directory apart from the topmost one, don't descend into it */
-            result = FTW_SKIP_SUBTREE;
-        }
-        break;
-
-    case FTW_F:
-        /* we were given a file - is it executable? */
-        if ( faccessat( AT_FDCWD, path, X_OK, 0 ) == 0 )
-        {
-            int pathLen = strlen( path );
-            tExecutable * executable = calloc( 1, sizeof( tExecutable ) + pathLen );
-            if ( executable != NULL )
-            {
-                memcpy( executable->path, path, pathLen );
-                char * name = strrchr( path, '/' );
-                if ( name != NULL )
-                {
-                    executable->nameOffset = name - path + 1;
-                }
-                tExecutable ** prev = &executableHead;
-                tExecutable *  exct = executableHead;
-                while ( exct != NULL )
-                {
-                    if ( strcoll( &executable->path[ executable->nameOffset ],
-                                  &exct->path[ exct->nameOffset ] ) < 0 )
-                    {
-                        /* insert the new entry before this one */
-                        break;
-                    }
-                    prev = &exct->next;
-                    exct = exct->next;
-                }
-                executable->next = exct;
-                *prev = executable;
-            }
-        }
-        break;
-
-    default:
-        break;
+        result = cuckooRun( plan, argv, envp, NULL, NULL );
+        cuckooRelease( plan );
     }
 
     return result;
 }
 
 /**
- * @brief
- * @param argv
+ * @brief implements 'cuckoo --analyze <path> [<argument>...]' - runs the chain serially,
+ *        watching which files each hook accesses, and proposes how it could be parallelized
+ * @param argc
+ * @param argv the arguments following '--analyze'
  * @param envp
- * @return
+ * @return exit code
  */
-int invoke( char * argv[], char * envp[] )
+int analyze( int argc, char * argv[], char * envp[] )
 {
-    int result = 0;
+    int result = -1;
 
-    // debugf("    argv[0]: %s\n", argv[0] );
+    if ( argc < 1 || argv[0][0] == '-' )
+    {
+        usage( "please provide the path of the hooked executable to analyze\n" );
+        return -1;
+    }
 
-    const char * installPath = absolutePath( argv[0] );
-    if ( installPath != NULL )
+    tCuckooPlan * plan = cuckooPlan( argv[0] );
+    if ( plan != NULL )
     {
-        const char * scriptsDir = getScriptsDir( installPath );
-        if ( scriptsDir != NULL )
+        tAnalysis analysis = { NULL, 0, 0, { NULL, NULL, NULL }, { NULL, 0, 0 } };
+
+        for ( size_t i = 0; i < cuckooPlanSize( plan ); ++i )
         {
-            const char * commonDir = getCommonDir( installPath );
-            if (commonDir != NULL )
+            const tCuckooHook * hook = cuckooPlanHook( plan, i );
+            if ( hook->broken )
             {
-#if 0
-                debugf( "     argv[0]: %s\n"
-                        " installPath: %s\n"
-                        "  scriptsDir: %s\n"
-                        "   commonDir: %s\n",
-                        argv[0], installPath, scriptsDir, commonDir );
-#endif
-                executableHead = NULL;
-
-                nftw( scriptsDir, forEachEntry, 2, FTW_ACTIONRETVAL );
-                nftw( commonDir,  forEachEntry, 2, FTW_ACTIONRETVAL );
-
-                tExecutable * executable = executableHead;
-                while ( executable != NULL)
-                {
-                    argv[0] = executable->path;
-                    // debugf( "launch %s", argv[0] );
-                    int res = launch( argv, envp );
-                    if ( result == 0 && res != 0 )
-                    {
-                        result = res;
-                    }
-
-                    /* done with this one, so free it */
-                    tExecutable * f = executable;
-                    executable = executable->next;
-                    free( f );
-                }
-
-                executableHead = NULL;
-
-                free( (void *)commonDir );
+                fprintf( stderr, "skipping %s, as verification found it broken\n", hook->path );
+            }
+            else
+            {
+                argv[0] = (char *)hook->path;
+                analyzeHook( &analysis, hook->name, argv, envp );
             }
-            free( (void *)scriptsDir );
         }
-        free( (void *)installPath );
-    }
+        cuckooRelease( plan );
 
+        reportAnalysis( &analysis );
+        freeAnalysis( &analysis );
+        result = 0;
+    }
     return result;
 }
 
@@ -682,8 +381,36 @@ int main( int argc, char * argv[], char * envp[] )
 
         if ( strcmp( myName, "cuckoo" ) == 0 )
         {
+            if ( argc >= 2 && strcmp( argv[1], "--stats" ) == 0 )
+            {
+                result = showStats( argc - 2, &argv[2] );
+            }
+            else if ( argc >= 2 && strcmp( argv[1], "--verify" ) == 0 )
+            {
+                result = verify( argc - 2, &argv[2] );
+            }
+            else if ( argc >= 2 && strcmp( argv[1], "--status" ) == 0 )
+            {
+                result = showStatus( argc - 2, &argv[2] );
+            }
+            else if ( argc >= 2 && strcmp( argv[1], "--metrics" ) == 0 )
+            {
+                result = showMetrics( argc - 2, &argv[2] );
+            }
+            else if ( argc >= 2 && strcmp( argv[1], "--analyze" ) == 0 )
+            {
+                result = analyze( argc - 2, &argv[2], envp );
+            }
+            else if ( argc >= 2 && strcmp( argv[1], "--compare" ) == 0 )
+            {
+                result = showComparison( argc - 2, &argv[2] );
+            }
+            else if ( argc >= 2 && strcmp( argv[1], "--drain-spool" ) == 0 )
+            {
+                result = drainSpool( argc - 2, &argv[2] );
+            }
             /* it's an install */
-            if ( argc != 2 || argv[1] == NULL || strlen( argv[1] ) < 1 )
+            else if ( argc != 2 || argv[1] == NULL || strlen( argv[1] ) < 1 )
             {
                 usage("please provide the path to the executable to intercept");
             }
@@ -698,7 +425,9 @@ int main( int argc, char * argv[], char * envp[] )
             result = invoke( argv, envp );
         }
 
+        cuckooFlushPlans();
         closelog();
+        freeConfig();
 
         free( (void *)myName );
     }
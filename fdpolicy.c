@@ -0,0 +1,416 @@
+/**
+ * @file fdpolicy.c
+ *
+ * Which file descriptors a hook is launched with.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "report.h"
+#include "config.h"
+#include "fdpolicy.h"
+
+static const char * stdioNames[3] = { "stdin", "stdout", "stderr" };
+
+/**
+ * @brief open whatever a hook's stdin, stdout or stderr should be redirected to
+ * @param fds
+ * @param which 0, 1 or 2
+ */
+static void prepareRedirect( tHookFds * fds, int which )
+{
+    const char * target = getScopedConfigString( "hook", fds->hook, stdioNames[ which ], "inherit" );
+
+    if ( strcmp( target, "inherit" ) == 0 )
+    {
+        return;
+    }
+
+    if ( strcmp( target, "null" ) == 0 )
+    {
+        fds->stdio[ which ] = open( "/dev/null", ( which == 0 ? O_RDONLY : O_WRONLY ) | O_CLOEXEC );
+    }
+    else if ( strncmp( target, "file:", 5 ) == 0 )
+    {
+        fds->stdio[ which ] = open( target + 5,
+                                    ( which == 0 ? O_RDONLY : O_WRONLY | O_CREAT | O_APPEND ) | O_CLOEXEC,
+                                    0644 );
+    }
+    else if ( strcmp( target, "syslog" ) == 0 && which != 0 )
+    {
+        int pipeFds[2];
+        if ( pipe2( pipeFds, O_CLOEXEC ) == 0 )
+        {
+            fcntl( pipeFds[0], F_SETFL, fcntl( pipeFds[0], F_GETFL ) | O_NONBLOCK );
+            fds->pipes[ which ] = pipeFds[0];
+            fds->stdio[ which ] = pipeFds[1];
+        }
+    }
+    else
+    {
+        syslog( LOG_WARNING, "%s: unknown %s redirection \'%s\'", fds->hook, stdioNames[ which ], target );
+        return;
+    }
+
+    if ( fds->stdio[ which ] < 0 )
+    {
+        syslog( LOG_WARNING, "%s: unable to redirect %s to \'%s\' (%m)", fds->hook, stdioNames[ which ], target );
+    }
+}
+
+/**
+ * @brief add a descriptor to the (sorted, de-duplicated) list the hook will inherit
+ */
+static void keepFd( tHookFds * fds, int fd )
+{
+    if ( fd <= STDERR_FILENO || fds->keptCount >= kMaxKeptFds )
+    {
+        return;
+    }
+
+    int i = fds->keptCount;
+    while ( i > 0 && fds->kept[ i - 1 ] >= fd )
+    {
+        if ( fds->kept[ i - 1 ] == fd )
+        {
+            return;
+        }
+        --i;
+    }
+    memmove( &fds->kept[ i + 1 ], &fds->kept[ i ], ( fds->keptCount - i ) * sizeof( int ) );
+    fds->kept[ i ] = fd;
+    ++fds->keptCount;
+}
+
+/**
+ * @brief work out, before launching a hook, which descriptors it gets. Allocates; doesn't fork.
+ * @param fds
+ * @param hook the hook's name, for looking up its settings
+ * @param progressFd the hook's end of the progress channel, or -1
+ * @param dataFd the hook's end of the data channel, or -1
+ */
+void prepareHookFds( tHookFds * fds, const char * hook, int progressFd, int dataFd )
+{
+    memset( fds, 0, sizeof( tHookFds ) );
+    fds->hook = hook;
+    for ( int i = 0; i < 3; ++i )
+    {
+        fds->stdio[i] = -1;
+        fds->pipes[i] = -1;
+        prepareRedirect( fds, i );
+    }
+
+    keepFd( fds, progressFd );
+    keepFd( fds, dataFd );
+
+    /* 'fd.keep = 3, 7-9' - descriptors the caller passes that the hook genuinely needs */
+    const char * keep = getScopedConfigString( "hook", hook, "fd.keep", NULL );
+    while ( keep != NULL && *keep != '\0' )
+    {
+        char * end;
+        long first = strtol( keep, &end, 10 );
+        long last  = first;
+        if ( end == keep )
+        {
+            syslog( LOG_WARNING, "%s: can't parse fd.keep at \'%s\'", hook, keep );
+            break;
+        }
+        if ( *end == '-' )
+        {
+            keep = end + 1;
+            last = strtol( keep, &end, 10 );
+        }
+        for ( long fd = first; fd <= last && fd - first < kMaxKeptFds; ++fd )
+        {
+            keepFd( fds, (int)fd );
+        }
+        keep = end + strspn( end, ", \t" );
+    }
+
+    fds->closeOthers = getScopedConfigBool( "hook", hook, "fd.closeInherited", true );
+
+    struct rlimit limit;
+    fds->closeLimit = ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < 65536 )
+                    ? (int)limit.rlim_cur : 65536;
+}
+
+/**
+ * @brief is the hook given the caller's stdio as-is, with no other descriptors kept open?
+ *        (Closing inherited descriptors is allowed - that needs no preparation.)
+ * @param hook the hook's name
+ * @return false if prepareHookFds() has anything to do for it
+ */
+bool hookFdsPlain( const char * hook )
+{
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( strcmp( getScopedConfigString( "hook", hook, stdioNames[i], "inherit" ), "inherit" ) != 0 )
+        {
+            return false;
+        }
+    }
+    return ( getScopedConfigString( "hook", hook, "fd.keep", NULL ) == NULL );
+}
+
+/**
+ * @brief pipe2( fds, O_CLOEXEC ), but with both ends above stderr. If we were started with stdio
+ *        closed, pipe2() could return 0, 1 or 2 - which the hook would take for its stdio, and
+ *        keepFd() wouldn't pass on.
+ * @param fds
+ * @return 0, or -1 with errno set
+ */
+int pipeAboveStdio( int fds[2] )
+{
+    if ( pipe2( fds, O_CLOEXEC ) != 0 )
+    {
+        return -1;
+    }
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( fds[i] <= STDERR_FILENO )
+        {
+            int moved = fcntl( fds[i], F_DUPFD_CLOEXEC, STDERR_FILENO + 1 );
+            if ( moved < 0 )
+            {
+                int error = errno;
+                close( fds[0] );
+                close( fds[1] );
+                errno = error;
+                return -1;
+            }
+            close( fds[i] );
+            fds[i] = moved;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief close every descriptor from 'first' to 'last' inclusive
+ */
+void closeRange( int first, int last )
+{
+    if ( first > last )
+    {
+        return;
+    }
+    if ( syscall( SYS_close_range, (unsigned int)first, (unsigned int)last, 0 ) != 0 )
+    {
+        /* kernel older than 5.9 */
+        for ( int fd = first; fd <= last; ++fd )
+        {
+            close( fd );
+        }
+    }
+}
+
+/**
+ * @brief carry on as a daemon: double forked (so it's inherited by init, rather than becoming
+ *        the caller's zombie), in a session of its own, in '/', with stdin, stdout and stderr on
+ *        /dev/null and nothing else open, so it holds nothing the caller's caller may wait on
+ * @param keep descriptors to leave open. Any at or below stderr are moved above it, and the
+ *             array updated to match.
+ * @param count how many there are
+ * @return 0 in the daemon, which should _exit() when it's done. In the caller, the pid of the
+ *         intermediate child (which has already exited), or -1 if it couldn't be forked.
+ */
+pid_t daemonize( int keep[], int count )
+{
+    pid_t pid = fork();
+    if ( pid != 0 )
+    {
+        if ( pid > 0 )
+        {
+            waitpid( pid, NULL, 0 );
+        }
+        return pid;
+    }
+
+    if ( fork() != 0 )
+    {
+        _exit( 0 );
+    }
+    setsid();
+    if ( chdir( "/" ) != 0 )
+    {
+        syslog( LOG_WARNING, "unable to change to '/' (%m)" );
+    }
+
+    for ( int i = 0; i < count; ++i )
+    {
+        if ( keep[i] >= 0 && keep[i] <= STDERR_FILENO )
+        {
+            keep[i] = fcntl( keep[i], F_DUPFD_CLOEXEC, STDERR_FILENO + 1 );
+        }
+    }
+
+    closelog();
+    int devNull = open( "/dev/null", O_RDWR );
+    for ( int fd = STDIN_FILENO; fd <= STDERR_FILENO && devNull >= 0; ++fd )
+    {
+        dup2( devNull, fd );
+    }
+
+    /* close the gaps between the kept descriptors, lowest first */
+    int next = STDERR_FILENO + 1;
+    for (;;)
+    {
+        int lowest = -1;
+        for ( int i = 0; i < count; ++i )
+        {
+            if ( keep[i] >= next && ( lowest < 0 || keep[i] < lowest ) )
+            {
+                lowest = keep[i];
+            }
+        }
+        if ( lowest < 0 )
+        {
+            break;
+        }
+        closeRange( next, lowest - 1 );
+        next = lowest + 1;
+    }
+    closeRange( next, (int)sysconf( _SC_OPEN_MAX ) - 1 );
+    return 0;
+}
+
+/**
+ * @brief apply the policy. Called in the (vfork) child just before execve(), so only
+ *        async-signal-safe calls, and nothing that touches memory we share with the parent.
+ * @param fds
+ */
+void applyHookFds( const tHookFds * fds )
+{
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( fds->stdio[i] >= 0 )
+        {
+            /* the duplicate doesn't inherit O_CLOEXEC */
+            dup2( fds->stdio[i], i );
+        }
+    }
+
+    for ( int i = 0; i < fds->keptCount; ++i )
+    {
+        fcntl( fds->kept[i], F_SETFD, 0 );
+    }
+
+    if ( fds->closeOthers )
+    {
+        int next = STDERR_FILENO + 1;
+        for ( int i = 0; i < fds->keptCount; ++i )
+        {
+            closeRange( next, fds->kept[i] - 1 );
+            next = fds->kept[i] + 1;
+        }
+        if ( syscall( SYS_close_range, (unsigned int)next, ~0U, 0 ) != 0 )
+        {
+            closeRange( next, fds->closeLimit );
+        }
+    }
+}
+
+/**
+ * @brief the hook has been launched, so close our copies of the descriptors we opened for it
+ * @param fds
+ */
+void hookFdsStarted( tHookFds * fds )
+{
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( fds->stdio[i] >= 0 )
+        {
+            close( fds->stdio[i] );
+            fds->stdio[i] = -1;
+        }
+    }
+}
+
+/**
+ * @brief log whatever the hook has written to a 'syslog' redirection, a line at a time
+ * @param fds
+ * @param which 1 or 2
+ */
+void relayHookOutput( tHookFds * fds, int which )
+{
+    while ( fds->pipes[ which ] >= 0 )
+    {
+        char * buffer = fds->lines[ which ];
+        ssize_t len = read( fds->pipes[ which ], buffer + fds->used[ which ],
+                            sizeof( fds->lines[0] ) - 1 - fds->used[ which ] );
+        if ( len < 0 && ( errno == EAGAIN || errno == EINTR ) )
+        {
+            break;
+        }
+
+        if ( len <= 0 )
+        {
+            if ( fds->used[ which ] > 0 )
+            {
+                buffer[ fds->used[ which ] ] = '\0';
+                syslog( which == 2 ? LOG_WARNING : LOG_INFO, "%s: %s", fds->hook, buffer );
+                fds->used[ which ] = 0;
+            }
+            close( fds->pipes[ which ] );
+            fds->pipes[ which ] = -1;
+            break;
+        }
+
+        fds->used[ which ] += len;
+        buffer[ fds->used[ which ] ] = '\0';
+
+        char * line = buffer;
+        char * newline;
+        while ( ( newline = strchr( line, '\n' ) ) != NULL )
+        {
+            *newline = '\0';
+            syslog( which == 2 ? LOG_WARNING : LOG_INFO, "%s: %s", fds->hook, line );
+            line = newline + 1;
+        }
+
+        fds->used[ which ] -= line - buffer;
+        if ( fds->used[ which ] >= sizeof( fds->lines[0] ) - 1 )
+        {
+            /* a long line - log what we have so far */
+            syslog( which == 2 ? LOG_WARNING : LOG_INFO, "%s: %s", fds->hook, line );
+            fds->used[ which ] = 0;
+        }
+        else
+        {
+            memmove( buffer, line, fds->used[ which ] );
+        }
+    }
+}
+
+/**
+ * @brief the hook has exited - log anything left over and close everything
+ * @param fds
+ */
+void closeHookFds( tHookFds * fds )
+{
+    hookFdsStarted( fds );
+    for ( int i = 1; i < 3; ++i )
+    {
+        /* drains to EOF, unless something the hook started is still holding the pipe open */
+        relayHookOutput( fds, i );
+        if ( fds->pipes[i] >= 0 )
+        {
+            close( fds->pipes[i] );
+            fds->pipes[i] = -1;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file fdpolicy.h
+ *
+ * Which file descriptors a hook is launched with. By default a hook gets the
+ * caller's stdin, stdout and stderr plus any progress and data channels, and
+ * nothing else - any other descriptors the caller leaked are closed, so they
+ * can't delay EOF on a pipe the caller is waiting on. Everything cuckoo opens
+ * itself is O_CLOEXEC.
+ *
+ * Per hook, each of stdin, stdout and stderr can be redirected:
+ *     inherit          the caller's (the default)
+ *     null             /dev/null
+ *     file:<path>      a file - appended to, for stdout and stderr
+ *     syslog           (stdout and stderr only) a pipe into cuckoo, logged line by line
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_FDPOLICY_H
+#define CUCKOO_FDPOLICY_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define kMaxKeptFds     32
+
+typedef struct {
+    int    stdio[3];            /* dup2()'d onto 0, 1 and 2 in the child, or -1 to inherit */
+    int    pipes[3];            /* our read end of a 'syslog' redirection, or -1 */
+    int    kept[ kMaxKeptFds ]; /* descriptors above stderr the hook inherits, in ascending order */
+    int    keptCount;
+    bool   closeOthers;         /* close everything else above stderr */
+    int    closeLimit;          /* highest descriptor to close if close_range() isn't available */
+    const char * hook;
+    char   lines[3][ 256 ];     /* partial lines read from 'pipes' */
+    size_t used[3];
+} tHookFds;
+
+void prepareHookFds( tHookFds * fds, const char * hook, int progressFd, int dataFd );
+void applyHookFds(   const tHookFds * fds );
+void hookFdsStarted( tHookFds * fds );
+void relayHookOutput( tHookFds * fds, int which );
+void closeHookFds(   tHookFds * fds );
+bool hookFdsPlain(   const char * hook );
+
+int   pipeAboveStdio( int fds[2] );
+void  closeRange( int first, int last );
+pid_t daemonize(  int keep[], int count );
+
+#endif /* CUCKOO_FDPOLICY_H */
@@ -0,0 +1,463 @@
+/**
+ * @file history.c
+ *
+ * An append-only binary log with one fixed-size record for every hook cuckoo
+ * runs, rotated by size, and the '--stats' report computed from it.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+
+static int          historyFd = -1;
+static bool         historyDisabled;
+static const char * historyPath;
+
+/**
+ * @brief open the history file for appending, the first time it's needed
+ * @return true if records can be appended
+ */
+static bool openHistory( void )
+{
+    if ( historyFd < 0 && !historyDisabled )
+    {
+        historyPath = getConfigString( "history.file", kHistoryPath );
+        if ( *historyPath == '\0' )
+        {
+            /* explicitly turned off */
+            historyDisabled = true;
+        }
+        else
+        {
+            historyFd = open( historyPath, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644 );
+            if ( historyFd < 0 )
+            {
+                /* don't let a missing /var/lib/cuckoo get in the way of running the hooks */
+                syslog( LOG_WARNING, "history disabled: unable to open \'%s\' (%m)", historyPath );
+                historyDisabled = true;
+            }
+        }
+    }
+    return ( historyFd >= 0 );
+}
+
+/**
+ * @brief if the history file has reached its size limit, rename it to '<file>.1' and start a new one.
+ *
+ * Concurrent invocations may all notice the limit at once, so the rename is done
+ * under an exclusive lock, and only if the path still refers to the file we have
+ * open. Anyone still holding the old file open simply appends to '<file>.1'.
+ */
+static void rotateHistory( void )
+{
+    struct stat fdStat;
+
+    long maxSize = getConfigNumber( "history.maxSize", kHistoryMaxSize );
+    if ( maxSize <= 0
+      || fstat( historyFd, &fdStat ) != 0
+      || fdStat.st_size + (off_t)sizeof( tHistoryRecord ) <= maxSize )
+    {
+        return;
+    }
+
+    if ( flock( historyFd, LOCK_EX ) == 0 )
+    {
+        struct stat pathStat;
+        if ( stat( historyPath, &pathStat ) == 0
+          && pathStat.st_dev == fdStat.st_dev
+          && pathStat.st_ino == fdStat.st_ino )
+        {
+            char * rotatedPath = NULL;
+            asprintf( &rotatedPath, "%s.1", historyPath );
+            if ( rotatedPath != NULL )
+            {
+                if ( rename( historyPath, rotatedPath ) != 0 )
+                {
+                    syslog( LOG_WARNING, "unable to rotate \'%s\' (%m)", historyPath );
+                }
+                free( rotatedPath );
+            }
+        }
+        flock( historyFd, LOCK_UN );
+    }
+
+    close( historyFd );
+    historyFd = -1;
+    openHistory();
+}
+
+/**
+ * @brief append a record to the history file. Failures are not fatal.
+ * @param record
+ */
+void historyAppend( const tHistoryRecord * record )
+{
+    if ( openHistory() )
+    {
+        rotateHistory();
+
+        /* a single write() of a small record to an O_APPEND file won't interleave with other writers */
+        if ( historyFd >= 0 && write( historyFd, record, sizeof( tHistoryRecord ) ) != sizeof( tHistoryRecord ) )
+        {
+            syslog( LOG_WARNING, "unable to append to \'%s\' (%m)", historyPath );
+        }
+    }
+}
+
+/**
+ * @brief
+ */
+void historyClose( void )
+{
+    if ( historyFd >= 0 )
+    {
+        close( historyFd );
+        historyFd = -1;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief read every record in 'path' that started at or after 'since' (and matches 'target', if given)
+ * @param history
+ * @param path
+ * @param since nanoseconds
+ * @param target may be NULL
+ * @return 0 on success, otherwise an errno value
+ */
+static int readHistory( tHistory * history, const char * path, uint64_t since, const char * target )
+{
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return ( errno == ENOENT ) ? 0 : reportErrno( "unable to open \'%s\'", path );
+    }
+
+    struct stat fileStat;
+    if ( fstat( fd, &fileStat ) != 0 )
+    {
+        int result = reportErrno( "unable to get information about \'%s\'", path );
+        close( fd );
+        return result;
+    }
+
+    unsigned char * buffer = malloc( fileStat.st_size + 1 );
+    ssize_t length = 0;
+    if ( buffer != NULL )
+    {
+        ssize_t len;
+        while ( length < fileStat.st_size
+             && ( len = read( fd, buffer + length, fileStat.st_size - length ) ) > 0 )
+        {
+            length += len;
+        }
+    }
+    close( fd );
+
+    const unsigned char * p   = buffer;
+    const unsigned char * end = buffer + length;
+    while ( p + 2 * sizeof( uint16_t ) <= end )
+    {
+        uint16_t magic, size;
+        memcpy( &magic, p, sizeof( magic ) );
+        memcpy( &size,  p + sizeof( magic ), sizeof( size ) );
+        if ( magic != kHistoryMagic || size < offsetof( tHistoryRecord, hook ) + kHistoryHookLen || p + size > end )
+        {
+            reportError( "\'%s\' is corrupt at offset %ld", path, (long)( p - buffer ) );
+            break;
+        }
+
+        tHistoryRecord record;
+        memset( &record, 0, sizeof( record ) );
+        memcpy( &record, p, size < sizeof( record ) ? size : sizeof( record ) );
+        record.target[ kHistoryTargetLen - 1 ] = '\0';
+        record.hook[ kHistoryHookLen - 1 ]     = '\0';
+        p += size;
+
+        if ( record.started < since
+          || ( target != NULL && strcmp( record.target, target ) != 0 ) )
+        {
+            continue;
+        }
+
+        if ( history->count >= history->allocated )
+        {
+            size_t allocated = history->allocated ? history->allocated * 2 : 1024;
+            tHistoryRecord * records = realloc( history->records, allocated * sizeof( tHistoryRecord ) );
+            if ( records == NULL )
+            {
+                break;
+            }
+            history->records   = records;
+            history->allocated = allocated;
+        }
+        history->records[ history->count++ ] = record;
+    }
+
+    free( buffer );
+    return 0;
+}
+
+/**
+ * @brief qsort() comparator, ordering records by target, then hook, then start time
+ */
+int compareHistoryRecords( const void * a, const void * b )
+{
+    const tHistoryRecord * left  = a;
+    const tHistoryRecord * right = b;
+
+    int result = strcmp( left->target, right->target );
+    if ( result == 0 )
+    {
+        result = strcmp( left->hook, right->hook );
+    }
+    if ( result == 0 )
+    {
+        result = ( left->started > right->started ) - ( left->started < right->started );
+    }
+    return result;
+}
+
+/**
+ * @brief read the current and rotated history files
+ * @param history
+ * @param since only records that started at or after this time (CLOCK_REALTIME, in nanoseconds)
+ * @param target only records for this target, or every target if NULL
+ * @return 0 on success, otherwise an errno value
+ */
+int loadHistory( tHistory * history, uint64_t since, const char * target )
+{
+    const char * path = getConfigString( "history.file", kHistoryPath );
+    if ( *path == '\0' )
+    {
+        reportError( "history is disabled in the configuration" );
+        return -1;
+    }
+
+    char * rotatedPath = NULL;
+    asprintf( &rotatedPath, "%s.1", path );
+    if ( rotatedPath != NULL )
+    {
+        readHistory( history, rotatedPath, since, target );
+        free( rotatedPath );
+    }
+    return readHistory( history, path, since, target );
+}
+
+void freeHistory( tHistory * history )
+{
+    free( history->records );
+    history->records   = NULL;
+    history->count     = 0;
+    history->allocated = 0;
+}
+
+/**
+ * @brief
+ * @param clock CLOCK_REALTIME or CLOCK_MONOTONIC
+ * @return the current time, in nanoseconds
+ */
+uint64_t nowNanoseconds( int clock )
+{
+    struct timespec now;
+    clock_gettime( clock, &now );
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int compareDurations( const void * a, const void * b )
+{
+    uint64_t left  = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return ( left > right ) - ( left < right );
+}
+
+/**
+ * @brief nearest-rank percentile of a sorted array
+ */
+uint64_t historyPercentile( const uint64_t * sorted, size_t count, unsigned int pct )
+{
+    size_t rank = ( count * pct + 99 ) / 100;
+    return sorted[ rank > 0 ? rank - 1 : 0 ];
+}
+
+/**
+ * @brief format a duration in nanoseconds compactly, e.g. '850ms', '12.4s' or '41m'
+ */
+const char * formatDuration( uint64_t ns, char * buffer, size_t size )
+{
+    double ms = ns / 1e6;
+
+    if ( ms < 1000.0 )
+    {
+        snprintf( buffer, size, "%.0fms", ms );
+    }
+    else if ( ms < 100 * 1000.0 )
+    {
+        snprintf( buffer, size, "%.1fs", ms / 1000.0 );
+    }
+    else
+    {
+        snprintf( buffer, size, "%.0fm", ms / 60000.0 );
+    }
+    return buffer;
+}
+
+bool hookFailed( const tHistoryRecord * record )
+{
+    return !WIFEXITED( record->status ) || WEXITSTATUS( record->status ) != 0;
+}
+
+/**
+ * @brief summarize one (target, hook) group of records, sorted by start time
+ */
+static void reportGroup( const tHistoryRecord * group, size_t count, uint64_t midpoint )
+{
+    uint64_t * durations = malloc( count * sizeof( uint64_t ) );
+    if ( durations == NULL )
+    {
+        return;
+    }
+
+    size_t   failures = 0;
+    size_t   older    = 0;
+    uint32_t maxRss   = 0;
+    uint64_t cpuMs    = 0;
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        durations[i] = group[i].duration;
+        if ( hookFailed( &group[i] ) )
+        {
+            ++failures;
+        }
+        if ( group[i].started < midpoint )
+        {
+            ++older;
+        }
+        if ( group[i].maxRssKb > maxRss )
+        {
+            maxRss = group[i].maxRssKb;
+        }
+        cpuMs += group[i].userMs + group[i].systemMs;
+    }
+
+    /* trend: compare the median of the older half of the window with that of the newer half */
+    char trend[16] = "-";
+    size_t newer = count - older;
+    if ( older >= 3 && newer >= 3 )
+    {
+        qsort( durations, older, sizeof( uint64_t ), compareDurations );
+        qsort( durations + older, newer, sizeof( uint64_t ), compareDurations );
+        double before = historyPercentile( durations, older, 50 );
+        double after  = historyPercentile( durations + older, newer, 50 );
+        if ( before > 0 )
+        {
+            snprintf( trend, sizeof( trend ), "%+.0f%%", ( after - before ) * 100.0 / before );
+        }
+    }
+
+    qsort( durations, count, sizeof( uint64_t ), compareDurations );
+
+    char p50[16], p90[16], p99[16], max[16], cpu[16];
+    printf( "%-16s %-28s %6zu %6.1f%% %8s %8s %8s %8s %8s %8uM %7s\n",
+            group->target, group->hook, count,
+            failures * 100.0 / count,
+            formatDuration( historyPercentile( durations, count, 50 ), p50, sizeof( p50 ) ),
+            formatDuration( historyPercentile( durations, count, 90 ), p90, sizeof( p90 ) ),
+            formatDuration( historyPercentile( durations, count, 99 ), p99, sizeof( p99 ) ),
+            formatDuration( durations[ count - 1 ], max, sizeof( max ) ),
+            formatDuration( cpuMs * 1000000 / count, cpu, sizeof( cpu ) ),
+            ( maxRss + 1023 ) / 1024,
+            trend );
+
+    free( durations );
+}
+
+/**
+ * @brief implements 'cuckoo --stats [--window <duration>] [<target>]'
+ * @param argc
+ * @param argv the arguments following '--stats'
+ * @return exit code
+ */
+int showStats( int argc, char * argv[] )
+{
+    long         window = 7 * 24 * 60 * 60;
+    const char * target = NULL;
+
+    for ( int i = 0; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "--window" ) == 0 && i + 1 < argc )
+        {
+            window = parseDuration( argv[++i], -1 );
+            if ( window < 0 )
+            {
+                return -1;
+            }
+        }
+        else if ( argv[i][0] != '-' && target == NULL )
+        {
+            target = argv[i];
+        }
+        else
+        {
+            reportError( "unexpected argument \'%s\'", argv[i] );
+            return -1;
+        }
+    }
+
+    uint64_t nowNs = nowNanoseconds( CLOCK_REALTIME );
+    uint64_t since = nowNs - (uint64_t)window * 1000000000;
+
+    tHistory history = { NULL, 0, 0 };
+    int result = loadHistory( &history, since, target );
+
+    if ( result == 0 )
+    {
+        if ( history.count == 0 )
+        {
+            printf( "no hook executions recorded in the last %lds\n", window );
+        }
+        else
+        {
+            qsort( history.records, history.count, sizeof( tHistoryRecord ), compareHistoryRecords );
+
+            printf( "%-16s %-28s %6s %7s %8s %8s %8s %8s %8s %9s %7s\n",
+                    "target", "hook", "runs", "failed", "p50", "p90", "p99", "max", "cpu", "rss", "trend" );
+
+            uint64_t midpoint = since + ( nowNs - since ) / 2;
+            size_t start = 0;
+            for ( size_t i = 1; i <= history.count; ++i )
+            {
+                if ( i == history.count
+                  || strcmp( history.records[i].target, history.records[start].target ) != 0
+                  || strcmp( history.records[i].hook,   history.records[start].hook )   != 0 )
+                {
+                    reportGroup( &history.records[start], i - start, midpoint );
+                    start = i;
+                }
+            }
+        }
+    }
+
+    freeHistory( &history );
+    return result;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file history.h
+ *
+ * An append-only binary log with one fixed-size record for every hook cuckoo
+ * runs, rotated by size, and the '--stats' report computed from it.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_HISTORY_H
+#define CUCKOO_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define kHistoryPath        "/var/lib/cuckoo/history"
+#define kHistoryMaxSize     (4L * 1024 * 1024)
+#define kHistoryMagic       0x6b63      /* 'ck' */
+
+#define kHistoryTargetLen   32
+#define kHistoryHookLen     64
+
+/* tHistoryRecord.flags */
+#define kHistoryChainStart  (1 << 0)    /* first hook of its chain; 'queued' is valid */
+#define kHistoryTimedOut    (1 << 1)    /* killed for exceeding its wall-clock timeout */
+#define kHistoryHeartbeatLost (1 << 2)  /* killed because its heartbeats stopped */
+#define kHistoryExecFailed  (1 << 3)    /* couldn't be executed, or was skipped as known to be broken */
+#define kHistoryCandidate   (1 << 4)    /* a canary candidate, run in place of the current version */
+#define kHistoryShadow      (1 << 5)    /* a canary candidate, run alongside the current version */
+#define kHistoryDeferred    (1 << 6)    /* run from the spool; 'queued' is how long it was spooled */
+
+/**
+ * One record per hook execution. 'size' is the size of the record as it was
+ * written, so a reader can step over records written by a newer (larger)
+ * version of this structure, and zero-fill the tail of an older one.
+ */
+typedef struct {
+    uint16_t  magic;
+    uint16_t  size;
+    uint32_t  flags;        /* kHistory* flags */
+    uint64_t  started;      /* CLOCK_REALTIME, in nanoseconds */
+    uint64_t  duration;     /* nanoseconds */
+    int32_t   pid;
+    int32_t   status;       /* as returned by wait4() */
+    uint32_t  userMs;       /* user CPU time */
+    uint32_t  systemMs;     /* system CPU time */
+    uint32_t  maxRssKb;     /* peak resident set size */
+    uint32_t  reserved;
+    char      target[ kHistoryTargetLen ];
+    char      hook[ kHistoryHookLen ];
+    uint64_t  queued;       /* nanoseconds the chain waited for a slot in queued mode,
+                               or if kHistoryDeferred, the job waited in the spool */
+    uint64_t  chain;        /* identifies the invocation, shared by every hook it ran */
+} tHistoryRecord;
+
+typedef struct {
+    tHistoryRecord * records;
+    size_t           count;
+    size_t           allocated;
+} tHistory;
+
+void     historyAppend( const tHistoryRecord * record );
+void     historyClose( void );
+
+int      loadHistory( tHistory * history, uint64_t since, const char * target );
+void     freeHistory( tHistory * history );
+uint64_t historyPercentile( const uint64_t * sorted, size_t count, unsigned int pct );
+int      compareDurations( const void * a, const void * b );
+int      compareHistoryRecords( const void * a, const void * b );
+bool     hookFailed( const tHistoryRecord * record );
+uint64_t nowNanoseconds( int clock );
+const char * formatDuration( uint64_t ns, char * buffer, size_t size );
+
+int  showStats( int argc, char * argv[] );
+
+#endif /* CUCKOO_HISTORY_H */
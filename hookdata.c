@@ -0,0 +1,246 @@
+/**
+ * @file hookdata.c
+ *
+ * Passing KEY=value pairs from one hook to the hooks after it.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <syslog.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "report.h"
+#include "config.h"
+#include "fdpolicy.h"
+#include "hookdata.h"
+
+/**
+ * @brief open the channel a hook will write its variables to
+ * @param data
+ * @param hook the hook's name, for logging
+ * @param vars where the hook's variables are collected
+ * @return false unless the hook has 'data = on', or if the channel couldn't be created (the hook runs without one)
+ */
+bool hookDataOpen( tHookData * data, const char * hook, tHookVars * vars )
+{
+    int fds[2];
+
+    memset( data, 0, sizeof( tHookData ) );
+    data->readFd  = -1;
+    data->writeFd = -1;
+    data->hook    = hook;
+    data->vars    = vars;
+
+    /* opt-in, as only a hook written to pass data on needs it - and the shim can't provide it */
+    if ( !getScopedConfigBool( "hook", hook, "data", false ) )
+    {
+        return false;
+    }
+    if ( pipeAboveStdio( fds ) != 0 )
+    {
+        syslog( LOG_WARNING, "unable to create a data channel for \'%s\' (%m)", hook );
+        return false;
+    }
+
+    /* only our end is non-blocking - a hook writing to a full pipe should simply wait */
+    fcntl( fds[0], F_SETFL, fcntl( fds[0], F_GETFL ) | O_NONBLOCK );
+
+    data->readFd  = fds[0];
+    data->writeFd = fds[1];
+    return true;
+}
+
+/**
+ * @brief the hook has been launched - close our copy of its end, so we see EOF when it closes its copy
+ * @param data
+ */
+void hookDataStarted( tHookData * data )
+{
+    if ( data->writeFd >= 0 )
+    {
+        close( data->writeFd );
+        data->writeFd = -1;
+    }
+}
+
+/* variables that change how later hooks (or their interpreters, or the loader) run, rather
+ * than what they work on - a hook mustn't be able to hand those to the next one */
+static const char * const deniedNames[] = {
+    "PATH", "IFS", "ENV", "BASH_ENV", "SHELLOPTS", "BASHOPTS", "PS4", "CDPATH", "GLOBIGNORE",
+    "HOME", "SHELL", "TMPDIR", "CLASSPATH", "HOSTALIASES", "LOCPATH", "NLSPATH", "TZDIR",
+    NULL
+};
+
+static const char * const deniedPrefixes[] = {
+    "CUCKOO_", "LD_", "BASH_FUNC_", "GCONV_", "GLIBC_", "MALLOC_",
+    "PYTHON", "PERL", "RUBY", "NODE_", "JAVA_", "_JAVA_", "LUA_",
+    NULL
+};
+
+/**
+ * @brief
+ * @param line
+ * @return true if 'line' is a 'KEY=value' a hook may pass on
+ */
+bool hookVarValid( const char * line )
+{
+    size_t nameLen = strcspn( line, "=" );
+    bool   valid   = ( line[ nameLen ] == '=' && nameLen > 0 && !isdigit( (unsigned char)line[0] ) );
+
+    for ( size_t i = 0; valid && i < nameLen; ++i )
+    {
+        valid = ( isalnum( (unsigned char)line[i] ) || line[i] == '_' );
+    }
+    for ( int i = 0; valid && deniedNames[i] != NULL; ++i )
+    {
+        valid = !( strlen( deniedNames[i] ) == nameLen && strncmp( line, deniedNames[i], nameLen ) == 0 );
+    }
+    for ( int i = 0; valid && deniedPrefixes[i] != NULL; ++i )
+    {
+        valid = ( strncmp( line, deniedPrefixes[i], strlen( deniedPrefixes[i] ) ) != 0 );
+    }
+    return valid;
+}
+
+/**
+ * @brief add or replace a variable
+ */
+static void setHookVar( tHookData * data, const char * line )
+{
+    tHookVars * vars    = data->vars;
+    size_t      nameLen = strcspn( line, "=" );
+
+    if ( !hookVarValid( line ) )
+    {
+        syslog( LOG_WARNING, "%s: ignored data \'%.*s\'", data->hook, (int)nameLen, line );
+        return;
+    }
+
+    size_t i = 0;
+    while ( i < vars->count && !( strncmp( vars->vars[i], line, nameLen + 1 ) == 0 ) )
+    {
+        ++i;
+    }
+
+    size_t size = vars->size + strlen( line ) + 1 - ( i < vars->count ? strlen( vars->vars[i] ) + 1 : 0 );
+    if ( size > kHookDataMaxSize || ( i == vars->count && vars->count >= kHookDataMaxVars ) )
+    {
+        syslog( LOG_WARNING, "%s: too much data, ignored \'%.*s\'", data->hook, (int)nameLen, line );
+        return;
+    }
+
+    char * var = strdup( line );
+    if ( var == NULL )
+    {
+        return;
+    }
+
+    if ( i == vars->count )
+    {
+        char ** grown = realloc( vars->vars, ( vars->count + 2 ) * sizeof( char * ) );
+        if ( grown == NULL )
+        {
+            free( var );
+            return;
+        }
+        vars->vars = grown;
+        vars->vars[ vars->count + 1 ] = NULL;
+        ++vars->count;
+    }
+    else
+    {
+        free( vars->vars[i] );
+    }
+    vars->vars[i] = var;
+    vars->size    = size;
+}
+
+/**
+ * @brief collect whatever the hook has written to the channel so far
+ * @param data
+ */
+void hookDataRead( tHookData * data )
+{
+    while ( data->readFd >= 0 )
+    {
+        ssize_t len = read( data->readFd, data->buffer + data->used,
+                            sizeof( data->buffer ) - 1 - data->used );
+        if ( len < 0 && ( errno == EAGAIN || errno == EINTR ) )
+        {
+            break;
+        }
+        if ( len <= 0 )
+        {
+            /* the hook (and anything it started) closed its end. A last line may lack its newline. */
+            if ( data->used > 0 )
+            {
+                data->buffer[ data->used ] = '\0';
+                setHookVar( data, data->buffer );
+                data->used = 0;
+            }
+            close( data->readFd );
+            data->readFd = -1;
+            break;
+        }
+
+        data->used += len;
+        data->buffer[ data->used ] = '\0';
+
+        char * line = data->buffer;
+        char * newline;
+        while ( ( newline = strchr( line, '\n' ) ) != NULL )
+        {
+            *newline = '\0';
+            if ( *line != '\0' )
+            {
+                setHookVar( data, line );
+            }
+            line = newline + 1;
+        }
+
+        data->used -= line - data->buffer;
+        memmove( data->buffer, line, data->used );
+        if ( data->used >= sizeof( data->buffer ) - 1 )
+        {
+            /* an absurdly long line - drop it */
+            syslog( LOG_WARNING, "%s: data line too long, ignored", data->hook );
+            data->used = 0;
+        }
+    }
+}
+
+/**
+ * @brief the hook has exited - collect anything left in the channel, and close it
+ * @param data
+ */
+void hookDataClose( tHookData * data )
+{
+    hookDataStarted( data );
+    /* drains to EOF, unless something the hook started is still holding the pipe open */
+    hookDataRead( data );
+    if ( data->readFd >= 0 )
+    {
+        close( data->readFd );
+        data->readFd = -1;
+    }
+}
+
+void freeHookVars( tHookVars * vars )
+{
+    for ( size_t i = 0; i < vars->count; ++i )
+    {
+        free( vars->vars[i] );
+    }
+    free( vars->vars );
+    vars->vars  = NULL;
+    vars->count = 0;
+    vars->size  = 0;
+}
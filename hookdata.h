@@ -0,0 +1,55 @@
+/**
+ * @file hookdata.h
+ *
+ * A channel for hooks to pass what they've learned to the hooks that run after
+ * them in the same chain. A hook configured with 'data' inherits the write end of
+ * a pipe, whose descriptor number is in CUCKOO_DATA_FD, and may write lines to it:
+ *
+ *     KEY=value
+ *
+ * Every later hook in the chain gets KEY in its environment, so it needn't work
+ * out the same thing again (e.g. the EDL path, or the show's duration). A later
+ * hook may set the same key again, replacing the earlier value. Keys must be
+ * valid environment variable names, and may not be one that changes how a hook
+ * runs rather than what it works on (PATH, IFS, BASH_ENV, PYTHONPATH, LD_* ...),
+ * nor start with 'CUCKOO_'.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_HOOKDATA_H
+#define CUCKOO_HOOKDATA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define kHookDataFdEnvVar   "CUCKOO_DATA_FD"
+#define kHookDataMaxVars    64
+#define kHookDataMaxSize    65536       /* total bytes of variables a chain may accumulate */
+
+/* the variables collected so far in this chain */
+typedef struct {
+    char **   vars;         /* "KEY=value", each malloc'd, NULL-terminated */
+    size_t    count;
+    size_t    size;         /* total bytes */
+} tHookVars;
+
+/* one hook's end of things */
+typedef struct {
+    int         readFd;     /* -1 once the hook closes its end */
+    int         writeFd;    /* the hook's end; closed in the parent once it's launched */
+    const char * hook;
+    tHookVars * vars;       /* where its variables go */
+    char        buffer[ 4096 ];
+    size_t      used;
+} tHookData;
+
+bool hookDataOpen(    tHookData * data, const char * hook, tHookVars * vars );
+void hookDataStarted( tHookData * data );
+void hookDataRead(    tHookData * data );
+void hookDataClose(   tHookData * data );
+
+void freeHookVars(    tHookVars * vars );
+bool hookVarValid(    const char * line );
+
+#endif /* CUCKOO_HOOKDATA_H */
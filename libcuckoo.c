@@ -0,0 +1,1179 @@
+/**
+ * @file libcuckoo.c
+ *
+ * Planning and running a target's hook chain - used by the impersonating symlink,
+ * and by anything else that embeds libcuckoo.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/limits.h>
+
+#include "report.h"
+#include "config.h"
+#include "paths.h"
+#include "history.h"
+#include "queue.h"
+#include "progress.h"
+#include "verify.h"
+#include "fdpolicy.h"
+#include "canary.h"
+#include "hookdata.h"
+#include "spool.h"
+#include "shim.h"
+#include "libcuckoo.h"
+
+#define kKillGrace      10      /* seconds between SIGTERM and SIGKILL for a hook that timed out */
+
+_Static_assert( kCuckooTimedOut      == kHistoryTimedOut,      "result flags must match the history's" );
+_Static_assert( kCuckooHeartbeatLost == kHistoryHeartbeatLost, "result flags must match the history's" );
+_Static_assert( kCuckooExecFailed    == kHistoryExecFailed,    "result flags must match the history's" );
+_Static_assert( kCuckooCandidate     == kHistoryCandidate,     "result flags must match the history's" );
+_Static_assert( kCuckooDeferred      == kHistoryDeferred,      "result flags must match the history's" );
+
+/**
+ * @brief make a copy of an environment with more variables in it
+ * @param envp array of environment values, terminated by null pointer.
+ * @param variables array of 'NAME=value', terminated by null pointer - each replaces any
+ *        existing definition of NAME
+ * @return a new array (caller should free), or NULL if out of memory
+ */
+static char ** envWith( char * envp[], char * variables[] )
+{
+    size_t count = 0;
+    size_t added = 0;
+
+    while ( envp[ count ] != NULL )
+    {
+        ++count;
+    }
+    while ( variables[ added ] != NULL )
+    {
+        ++added;
+    }
+
+    char ** result = calloc( count + added + 1, sizeof( char * ) );
+    if ( result != NULL )
+    {
+        size_t j = 0;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            bool replaced = false;
+            for ( size_t k = 0; k < added && !replaced; ++k )
+            {
+                replaced = ( strncmp( envp[i], variables[k], strcspn( variables[k], "=" ) + 1 ) == 0 );
+            }
+            if ( !replaced )
+            {
+                result[ j++ ] = envp[i];
+            }
+        }
+        for ( size_t k = 0; k < added; ++k )
+        {
+            result[ j++ ] = variables[k];
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief wait for a hook to exit, relaying its progress and output and enforcing its timeouts
+ * @param pid the hook
+ * @param progress the hook's progress channel
+ * @param fds the hook's descriptors, for relaying any output redirected to syslog
+ * @param timeout wall-clock limit in seconds, or 0 for none
+ * @param heartbeatTimeout limit in seconds between heartbeats, or 0 for none
+ * @param usage filled in with the hook's resource usage
+ * @param flags kHistoryTimedOut or kHistoryHeartbeatLost are added if the hook had to be killed
+ * @return wait status
+ */
+static int waitForHook( pid_t pid, tProgress * progress, tHookData * data, tHookFds * fds,
+                        long timeout, long heartbeatTimeout, struct rusage * usage, uint32_t * flags )
+{
+    int status = 0;
+
+    /* a pidfd lets us poll() for the hook's exit alongside its progress channel and output. Without
+     * one (kernels before 5.3), poll more often and check for the exit with waitid() instead. */
+    int      pidfd   = syscall( SYS_pidfd_open, pid, 0 );
+    uint64_t tick    = ( pidfd >= 0 ) ? 1000000000 : 100000000;
+    uint64_t started = nowNanoseconds( CLOCK_MONOTONIC );
+    uint64_t killAt  = 0;
+
+    for (;;)
+    {
+        uint64_t now      = nowNanoseconds( CLOCK_MONOTONIC );
+        uint64_t deadline = now + tick;     /* wake at least once a second to refresh the status */
+
+        if ( killAt != 0 )
+        {
+            if ( killAt < deadline ) deadline = killAt;
+        }
+        else
+        {
+            if ( timeout > 0 && started + timeout * 1000000000ULL < deadline )
+            {
+                deadline = started + timeout * 1000000000ULL;
+            }
+            if ( heartbeatTimeout > 0 && progress->heartbeat + heartbeatTimeout * 1000000000ULL < deadline )
+            {
+                deadline = progress->heartbeat + heartbeatTimeout * 1000000000ULL;
+            }
+        }
+
+        /* poll() ignores entries that are -1, e.g. once the hook closes its end of a pipe */
+        struct pollfd pollFds[5] = {
+            { .fd = pidfd,            .events = POLLIN },
+            { .fd = progress->readFd, .events = POLLIN },
+            { .fd = fds->pipes[1],    .events = POLLIN },
+            { .fd = fds->pipes[2],    .events = POLLIN },
+            { .fd = data->readFd,     .events = POLLIN }
+        };
+        int waitMs = ( deadline > now ) ? ( deadline - now + 999999 ) / 1000000 : 0;
+        if ( poll( pollFds, 5, waitMs ) < 0 && errno != EINTR )
+        {
+            break;
+        }
+
+        progressRead( progress );
+        if ( pollFds[4].revents != 0 ) hookDataRead( data );
+        if ( pollFds[2].revents != 0 ) relayHookOutput( fds, 1 );
+        if ( pollFds[3].revents != 0 ) relayHookOutput( fds, 2 );
+
+        if ( pidfd >= 0 )
+        {
+            if ( pollFds[0].revents != 0 )
+            {
+                /* the hook has exited */
+                break;
+            }
+        }
+        else
+        {
+            siginfo_t info;
+            info.si_pid = 0;
+            if ( waitid( P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT ) != 0 || info.si_pid != 0 )
+            {
+                break;
+            }
+        }
+
+        now = nowNanoseconds( CLOCK_MONOTONIC );
+        if ( killAt == 0 )
+        {
+            const char * reason = NULL;
+            if ( timeout > 0 && now >= started + timeout * 1000000000ULL )
+            {
+                *flags |= kHistoryTimedOut;
+                reason  = "ran for longer than its timeout";
+            }
+            else if ( heartbeatTimeout > 0 && now >= progress->heartbeat + heartbeatTimeout * 1000000000ULL )
+            {
+                *flags |= kHistoryHeartbeatLost;
+                reason  = "stopped sending heartbeats";
+            }
+
+            if ( reason != NULL )
+            {
+                syslog( LOG_WARNING, "%s/%s %s, terminating it", progress->target, progress->hook, reason );
+                kill( -pid, SIGTERM );
+                killAt = now + kKillGrace * 1000000000ULL;
+            }
+        }
+        else if ( now >= killAt )
+        {
+            syslog( LOG_WARNING, "%s/%s ignored SIGTERM, killing it", progress->target, progress->hook );
+            kill( -pid, SIGKILL );
+            killAt = UINT64_MAX;
+        }
+    }
+
+    if ( pidfd >= 0 )
+    {
+        close( pidfd );
+    }
+
+    /* wait4() rather than waitpid(), so we get the child's resource usage too */
+    wait4( pid, &status, 0, usage );
+    return status;
+}
+
+/**
+ * @brief launches an executable.
+ * @param argv array of arguments. argv[0] is path to executable. terminated by null pointer.
+ * @param envp array of environment values, terminated by null pointer.
+ * @param hook the hook's name, which its configuration, progress and data are found by. Not
+ *             necessarily the name it's logged under - that's a candidate's own, in 'record'.
+ * @param record filled in with the timing, status and resource usage of the execution.
+ * @param vars collects the variables the hook passes on to later hooks.
+ * @return exit code from the launched process.
+ */
+static int launch( char * argv[], char * envp[], const char * hook, tHistoryRecord * record, tHookVars * vars )
+{
+    int result = 0;
+    int status = 0;
+    struct rusage usage;
+    tProgress     progress;
+    tHookData     data;
+    tHookFds      fds;
+    char          progressVar[ 32 ];
+    char          dataVar[ 32 ];
+    char *        channelVars[ 3 ] = { NULL, NULL, NULL };
+    int           channelCount = 0;
+    char **       env = NULL;
+    volatile int  execErrno = 0;
+
+    long timeout          = parseDuration( getScopedConfigString( "hook", hook, "timeout", NULL ), 0 );
+    long heartbeatTimeout = parseDuration( getScopedConfigString( "hook", hook, "heartbeatTimeout", NULL ), 0 );
+
+    if ( progressOpen( &progress, record->target, hook ) )
+    {
+        /* tell the hook where to write its progress */
+        snprintf( progressVar, sizeof( progressVar ), "%s=%d", kProgressFdEnvVar, progress.writeFd );
+        channelVars[ channelCount++ ] = progressVar;
+    }
+    if ( hookDataOpen( &data, hook, vars ) )
+    {
+        /* and where to write whatever it wants to pass on to later hooks */
+        snprintf( dataVar, sizeof( dataVar ), "%s=%d", kHookDataFdEnvVar, data.writeFd );
+        channelVars[ channelCount++ ] = dataVar;
+    }
+    if ( channelCount > 0 )
+    {
+        env = envWith( envp, channelVars );
+    }
+    prepareHookFds( &fds, hook, progress.writeFd, data.writeFd );
+
+    memset( &usage, 0, sizeof( usage ) );
+    record->started = nowNanoseconds( CLOCK_REALTIME );
+    uint64_t startNs = nowNanoseconds( CLOCK_MONOTONIC );
+
+    /* `vfork()` is slightly more efficient than `fork()` for this common scenario,
+     * where the child immediately calls one of the variants of `execve()`, so it
+     * doesn't need to create a copy of the page tables, only to blow them away
+     * immediately by calling `execve()`
+     */
+    int pid = vfork();
+    switch ( pid )
+    {
+    case -1: /* fork failed */
+        syslog( LOG_ERR, "err: unable to launch \'%s\'", argv[0] );
+        result = errno;
+        break;
+
+    case 0: /* this execution thread is the child */
+        /* redirect stdio, let the hook inherit its end of the progress channel, close any leaked fds */
+        applyHookFds( &fds );
+        if ( timeout > 0 || heartbeatTimeout > 0 )
+        {
+            /* a process group of its own, so a timeout can take down anything it started, too */
+            setpgid( 0, 0 );
+        }
+        execve( argv[0], argv, env != NULL ? env : envp );
+
+        /* execve should never return... if it does, the child still shares our memory (thanks to
+         * vfork) so it can tell us why, then it must _exit() rather than return into our stack. */
+        execErrno = errno;
+        _exit( 127 );
+
+    default: /* this execution thread is the parent - 'pid' is of the child */
+        if ( execErrno != 0 )
+        {
+            syslog( LOG_ERR, "err: unable to execute \'%s\' (%s)", argv[0], strerror( execErrno ) );
+            record->flags |= kHistoryExecFailed;
+        }
+        progressStarted( &progress, pid );
+        hookFdsStarted( &fds );
+        hookDataStarted( &data );
+        status = waitForHook( pid, &progress, &data, &fds, timeout, heartbeatTimeout, &usage, &record->flags );
+        if ( WIFEXITED( status ) )
+        {
+            result = WEXITSTATUS( status );
+        }
+        else if ( WIFSIGNALED( status ) )
+        {
+            /* same convention as the shell, so a hook we had to kill isn't mistaken for a success */
+            result = 128 + WTERMSIG( status );
+        }
+        break;
+    }
+
+    closeHookFds( &fds );
+    hookDataClose( &data );
+    progressClose( &progress );
+    free( env );
+
+    record->duration = nowNanoseconds( CLOCK_MONOTONIC ) - startNs;
+    record->pid      = pid;
+    record->status   = status;
+    record->userMs   = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+    record->systemMs = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+    record->maxRssKb = usage.ru_maxrss;
+
+    return result;
+}
+
+
+static void stampInfo( const struct stat * info, tShimStamp * stamp )
+{
+    stamp->dev  = info->st_dev;
+    stamp->ino  = info->st_ino;
+    stamp->sec  = info->st_ctim.tv_sec;
+    stamp->nsec = info->st_ctim.tv_nsec;
+}
+
+static void stampPath( const char * path, tShimStamp * stamp )
+{
+    struct stat info;
+    memset( stamp, 0, sizeof( tShimStamp ) );
+    if ( stat( path, &info ) == 0 )
+    {
+        stampInfo( &info, stamp );
+    }
+}
+
+typedef struct sExecutable {
+    struct sExecutable *  next;
+    unsigned short        nameOffset;
+    bool                  broken;       /* verification found it broken, and it hasn't changed since */
+    struct sExecutable *  candidate;    /* its '.canary' version, if there is one */
+    tShimStamp            stamp;        /* as it was when it was found */
+    char                  path[1];
+} tExecutable;
+
+/* nftw() has no way to pass context to its callback */
+static tExecutable * executableHead;
+static tManifest *   manifest;
+
+/**
+ * @brief
+ * @param path
+ * @param info
+ * @param entryType
+ * @param ftw
+ * @return
+ */
+static int forEachEntry( const char * path, const struct stat *info, int entryType, struct FTW * ftw )
+{
+    int result = FTW_CONTINUE;
+
+    // reportErrno("level: %d, path: %s\n",  ftw->level, path );
+    switch (entryType)
+    {
+    case FTW_D:
+    case FTW_DP:
+    case FTW_DNR:
+        if ( ftw->level > 0 )
+        {
+            /* for any directory apart from the topmost one, don't descend into it */
+            result = FTW_SKIP_SUBTREE;
+        }
+        break;
+
+    case FTW_F:
+        /* we were given a file - is it executable? */
+        if ( faccessat( AT_FDCWD, path, X_OK, 0 ) == 0 )
+        {
+            int pathLen = strlen( path );
+            tExecutable * executable = calloc( 1, sizeof( tExecutable ) + pathLen );
+            if ( executable != NULL )
+            {
+                memcpy( executable->path, path, pathLen );
+                executable->broken = manifestSkip( manifest, path, info );
+                stampInfo( info, &executable->stamp );
+                char * name = strrchr( path, '/' );
+                if ( name != NULL )
+                {
+                    executable->nameOffset = name - path + 1;
+                }
+                tExecutable ** prev = &executableHead;
+                tExecutable *  exct = executableHead;
+                while ( exct != NULL )
+                {
+                    if ( strcoll( &executable->path[ executable->nameOffset ],
+                                  &exct->path[ exct->nameOffset ] ) < 0 )
+                    {
+                        /* insert the new entry before this one */
+                        break;
+                    }
+                    prev = &exct->next;
+                    exct = exct->next;
+                }
+                executable->next = exct;
+                *prev = executable;
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return result;
+}
+
+/**
+ * @brief take the candidate versions out of the list of hooks to run, and attach each to the
+ *        hook it's a candidate to replace
+ */
+static void attachCandidates( void )
+{
+    tExecutable ** prev = &executableHead;
+    tExecutable *  exct = executableHead;
+    while ( exct != NULL )
+    {
+        if ( !isCanary( exct->path ) )
+        {
+            prev = &exct->next;
+            exct = exct->next;
+            continue;
+        }
+
+        *prev = exct->next;
+
+        size_t baseLen = strlen( exct->path ) - strlen( kCanarySuffix );
+        tExecutable * base = executableHead;
+        while ( base != NULL
+             && !( strlen( base->path ) == baseLen && strncmp( base->path, exct->path, baseLen ) == 0 ) )
+        {
+            base = base->next;
+        }
+        if ( base != NULL && base->candidate == NULL )
+        {
+            base->candidate = exct;
+        }
+        else
+        {
+            syslog( LOG_WARNING, "%s has no current version to be a candidate for", exct->path );
+            free( exct );
+        }
+        exct = *prev;
+    }
+}
+
+
+/**
+ * @brief nftw() callback that removes everything it's given - used depth-first
+ */
+static int removeEntry( const char * path, const struct stat * info, int type, struct FTW * ftw )
+{
+    (void)info;
+    (void)type;
+    (void)ftw;
+
+    return remove( path );
+}
+
+/**
+ * @brief run a hook's candidate version in the background, on the same input as the current
+ *        version, but in a scratch working directory that's removed afterwards. Its output
+ *        (including any data it passes on) is discarded, and its outcome only goes into the history.
+ * @param argv the arguments the current version is given - argv[0] is replaced
+ * @param envp the environment the current version is given
+ * @param candidate the candidate's path
+ * @param base the record the current version will be logged with
+ */
+static void launchShadow( char * argv[], char * envp[], const char * candidate, const tHistoryRecord * base )
+{
+    char * cwd = getcwd( NULL, 0 );
+
+    /* detached, so it doesn't hold up the caller */
+    pid_t pid = daemonize( NULL, 0 );
+    switch ( pid )
+    {
+    case -1:
+        syslog( LOG_ERR, "err: unable to shadow '%s' (%m)", candidate );
+        break;
+
+    case 0:
+        {
+            /* the history's descriptor went with the rest */
+            historyClose();
+
+            /* not where the current version is running, so whatever it writes there can't collide
+             * with what the current version writes. It's told where that is, and that it's a shadow. */
+            const char * tmp       = getenv( "TMPDIR" );
+            char *       scratch   = NULL;
+            char *       shadowVar = NULL;
+            if ( asprintf( &scratch, "%s/cuckoo-shadow.XXXXXX", ( tmp != NULL && *tmp == '/' ) ? tmp : "/tmp" ) < 0
+              || mkdtemp( scratch ) == NULL || chdir( scratch ) != 0
+              || asprintf( &shadowVar, "%s=%s", kCanaryShadowEnvVar, ( cwd != NULL ) ? cwd : "" ) < 0 )
+            {
+                syslog( LOG_ERR, "err: unable to make a scratch directory to shadow '%s' in (%m)", candidate );
+                _exit( 0 );
+            }
+            char *  shadowVars[] = { shadowVar, NULL };
+            char ** env          = envWith( envp, shadowVars );
+
+            tHistoryRecord record;
+            memset( &record, 0, sizeof( record ) );
+            record.magic = kHistoryMagic;
+            record.size  = sizeof( record );
+            record.flags = kHistoryShadow;
+            record.chain = base->chain;
+            memcpy( record.target, base->target, sizeof( record.target ) );
+            const char * name = strrchr( candidate, '/' );
+            strncpy( record.hook, ( name != NULL ) ? name + 1 : candidate, sizeof( record.hook ) - 1 );
+
+            tHookVars discarded = { NULL, 0, 0 };
+            argv[0] = (char *)candidate;
+            launch( argv, ( env != NULL ) ? env : envp, base->hook, &record, &discarded );
+            historyAppend( &record );
+            historyClose();
+
+            /* nothing it left behind is wanted */
+            if ( chdir( "/" ) != 0 || nftw( scratch, removeEntry, 16, FTW_DEPTH | FTW_PHYS ) != 0 )
+            {
+                syslog( LOG_WARNING, "unable to remove '%s' after shadowing '%s' (%m)", scratch, candidate );
+            }
+        }
+        _exit( 0 );
+
+    default:
+        break;
+    }
+    free( cwd );
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+struct sCuckooPlan {
+    struct sCuckooPlan * next;          /* in the cache */
+    unsigned             references;
+    char *               installPath;
+    const char *         target;        /* points into installPath */
+    tShimStamp           stamps[2];     /* of the scripts and common directories, when they were scanned */
+    char *               dirs[2];
+    tExecutable *        executables;   /* owns the strings the hooks point to */
+    size_t               count;
+    tCuckooHook          hooks[];
+};
+
+static tCuckooPlan * planCache;
+
+int cuckooApiVersion( void )
+{
+    return kCuckooApiVersion;
+}
+
+/**
+ * @brief has anything been added to, removed from or renamed in either of the plan's directories?
+ */
+static bool planIsCurrent( const tCuckooPlan * plan )
+{
+    for ( int i = 0; i < 2; ++i )
+    {
+        tShimStamp stamp;
+        stampPath( plan->dirs[i], &stamp );
+        if ( memcmp( &stamp, &plan->stamps[i], sizeof( tShimStamp ) ) != 0 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void freeExecutables( tExecutable * executable )
+{
+    while ( executable != NULL )
+    {
+        tExecutable * f = executable;
+        executable = executable->next;
+        free( f->candidate );
+        free( f );
+    }
+}
+
+static void freePlan( tCuckooPlan * plan )
+{
+    freeExecutables( plan->executables );
+    free( plan->dirs[0] );
+    free( plan->dirs[1] );
+    free( plan->installPath );
+    free( plan );
+}
+
+/**
+ * @brief can cuckoo-shim run this hook by itself, i.e. is it configured to use none of the
+ *        features only the full runner provides?
+ */
+static bool shimCanRun( const tCuckooHook * hook, uint8_t * flags )
+{
+    if ( hook->broken || hook->candidate != NULL
+      || !hookFdsPlain( hook->name )
+      || getScopedConfigBool( "hook", hook->name, "data", false )
+      || getScopedConfigBool( "hook", hook->name, "progress", false )
+      || getScopedConfigBool( "hook", hook->name, "windowed", false )
+      || getScopedConfigString( "hook", hook->name, "timeout", NULL ) != NULL
+      || getScopedConfigString( "hook", hook->name, "heartbeatTimeout", NULL ) != NULL )
+    {
+        return false;
+    }
+
+    *flags = getScopedConfigBool( "hook", hook->name, "fd.closeInherited", true ) ? kShimCloseInherited : 0;
+    return true;
+}
+
+/**
+ * @brief point the target's symlink at the shim, or back at the runner, if it points at the
+ *        other now. The two are expected side by side; a symlink to anything else is left alone.
+ * @param installPath the symlink
+ * @param shim true for the shim
+ */
+static void pointLinkAt( const char * installPath, bool shim )
+{
+    char    current[ PATH_MAX ];
+    char *  wanted = NULL;
+    char *  temp   = NULL;
+    ssize_t len    = readlink( installPath, current, sizeof( current ) - 1 );
+
+    if ( len <= 0 || current[0] != '/' )
+    {
+        return;
+    }
+    current[ len ] = '\0';
+
+    const char * name = strrchr( current, '/' ) + 1;
+    const char * want = shim ? kShimName : kRunnerName;
+    if ( strcmp( name, want ) == 0 || ( strcmp( name, kShimName ) != 0 && strcmp( name, kRunnerName ) != 0 ) )
+    {
+        return;
+    }
+
+    /* renamed over the old one, so the target is never missing */
+    if ( asprintf( &wanted, "%.*s%s", (int)( name - current ), current, want ) >= 0
+      && access( wanted, X_OK ) == 0
+      && asprintf( &temp, "%s.cuckoo.%d", installPath, getpid() ) >= 0 )
+    {
+        unlink( temp );
+        if ( symlink( wanted, temp ) == 0 && rename( temp, installPath ) == 0 )
+        {
+            syslog( LOG_INFO, "%s now runs %s", installPath, wanted );
+        }
+        else
+        {
+            unlink( temp );
+        }
+    }
+    free( temp );
+    free( wanted );
+}
+
+/**
+ * @brief write the plan out for cuckoo-shim, if the whole chain is one it can run by itself.
+ *        Otherwise remove any earlier plan, so the shim hands off to us. Either way, the symlink
+ *        is pointed at whichever will run the chain, so it isn't exec'd via a shim that can only
+ *        hand off.
+ * @param plan
+ */
+static void writeShimPlan( const tCuckooPlan * plan )
+{
+    char * path = NULL;
+    char * temp = NULL;
+
+    size_t dirLen = plan->target - plan->installPath;
+    if ( asprintf( &path, "%.*s.%s%s", (int)dirLen, plan->installPath, plan->target, kShimPlanSuffix ) < 0 )
+    {
+        return;
+    }
+
+    bool eligible = getConfigBool( "shim", true )
+                 && getConfigNumber( "queue.limit", 0 ) <= 0;
+
+    const char * configPath  = getConfigPath();
+    const char * historyPath = getConfigString( "history.file", kHistoryPath );
+    size_t size = sizeof( tShimPlan ) + plan->count * ( sizeof( tShimStamp ) + 1 )
+                + strlen( configPath ) + strlen( plan->dirs[0] ) + strlen( plan->dirs[1] )
+                + strlen( historyPath ) + 4;
+    for ( size_t i = 0; i < plan->count; ++i )
+    {
+        size += strlen( plan->hooks[i].path ) + 1;
+    }
+
+    uint8_t * buffer = ( eligible && size <= kShimPlanMaxSize ) ? calloc( 1, size ) : NULL;
+    if ( buffer == NULL )
+    {
+        unlink( path );
+        free( path );
+        pointLinkAt( plan->installPath, false );
+        return;
+    }
+
+    tShimPlan *  header = (tShimPlan *)buffer;
+    tShimStamp * stamps = (tShimStamp *)( header + 1 );
+    uint8_t *    flags  = (uint8_t *)( stamps + plan->count );
+    char *       next   = (char *)( flags + plan->count );
+
+    header->magic   = kShimPlanMagic;
+    header->version = kShimPlanVersion;
+    header->size    = size;
+    header->count   = plan->count;
+    stampPath( configPath, &header->config );
+    header->dirs[0] = plan->stamps[0];
+    header->dirs[1] = plan->stamps[1];
+    header->historyMaxSize = getConfigNumber( "history.maxSize", kHistoryMaxSize );
+
+    next = stpcpy( next, configPath ) + 1;
+    next = stpcpy( next, plan->dirs[0] ) + 1;
+    next = stpcpy( next, plan->dirs[1] ) + 1;
+    next = stpcpy( next, historyPath ) + 1;
+
+    size_t i = 0;
+    for ( tExecutable * exct = plan->executables; exct != NULL; exct = exct->next, ++i )
+    {
+        if ( !shimCanRun( &plan->hooks[i], &flags[i] ) )
+        {
+            eligible = false;
+            break;
+        }
+        stamps[i] = exct->stamp;
+        next = stpcpy( next, exct->path ) + 1;
+    }
+
+    /* written to the side and renamed into place, so the shim never sees half a plan */
+    int  fd      = -1;
+    bool written = false;
+    if ( eligible && asprintf( &temp, "%s.%d", path, getpid() ) >= 0 )
+    {
+        fd = open( temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+    }
+    if ( fd >= 0 )
+    {
+        written = ( write( fd, buffer, size ) == (ssize_t)size );
+        close( fd );
+        written = written && rename( temp, path ) == 0;
+        if ( !written )
+        {
+            unlink( temp );
+            unlink( path );
+        }
+    }
+    else
+    {
+        /* not eligible, or we can't write beside the target - either way, don't leave a stale plan */
+        unlink( path );
+    }
+    pointLinkAt( plan->installPath, written );
+
+    free( temp );
+    free( buffer );
+    free( path );
+}
+
+/**
+ * @brief scan the target's directories for its hooks
+ * @param installPath absolute path of the hooked executable - the plan takes ownership
+ * @return NULL if the directories couldn't be found or created
+ */
+static tCuckooPlan * makePlan( char * installPath )
+{
+    const char * scriptsDir = getScriptsDir( installPath );
+    const char * commonDir  = ( scriptsDir != NULL ) ? getCommonDir( installPath ) : NULL;
+    if ( commonDir == NULL )
+    {
+        free( (void *)scriptsDir );
+        free( installPath );
+        return NULL;
+    }
+
+    /* stamp them before scanning, so a change made during the scan shows up next time */
+    tShimStamp stamps[2];
+    stampPath( scriptsDir, &stamps[0] );
+    stampPath( commonDir,  &stamps[1] );
+
+    executableHead = NULL;
+    manifest       = loadManifest( scriptsDir );
+
+    nftw( scriptsDir, forEachEntry, 2, FTW_ACTIONRETVAL );
+    nftw( commonDir,  forEachEntry, 2, FTW_ACTIONRETVAL );
+    attachCandidates();
+
+    freeManifest( manifest );
+    manifest = NULL;
+
+    size_t count = 0;
+    for ( tExecutable * exct = executableHead; exct != NULL; exct = exct->next )
+    {
+        ++count;
+    }
+
+    tCuckooPlan * plan = calloc( 1, sizeof( tCuckooPlan ) + count * sizeof( tCuckooHook ) );
+    if ( plan == NULL )
+    {
+        reportErrno( "unable to allocate memory" );
+        freeExecutables( executableHead );
+        executableHead = NULL;
+        free( (void *)commonDir );
+        free( (void *)scriptsDir );
+        free( installPath );
+        return NULL;
+    }
+
+    plan->installPath = installPath;
+    plan->target      = strrchr( installPath, '/' );
+    plan->target      = ( plan->target != NULL ) ? plan->target + 1 : installPath;
+    plan->dirs[0]     = (char *)scriptsDir;
+    plan->dirs[1]     = (char *)commonDir;
+    plan->stamps[0]   = stamps[0];
+    plan->stamps[1]   = stamps[1];
+    plan->executables = executableHead;
+    plan->count       = count;
+    executableHead    = NULL;
+
+    size_t i = 0;
+    for ( tExecutable * exct = plan->executables; exct != NULL; exct = exct->next, ++i )
+    {
+        tCuckooHook * hook = &plan->hooks[i];
+        hook->name   = &exct->path[ exct->nameOffset ];
+        hook->path   = exct->path;
+        hook->broken = exct->broken;
+        /* a candidate verification found broken isn't tried */
+        hook->candidate = ( exct->candidate != NULL && !exct->candidate->broken ) ? exct->candidate->path : NULL;
+    }
+
+    writeShimPlan( plan );
+    return plan;
+}
+
+/**
+ * @brief get the plan for running a target's hooks, scanning its directories only if they've
+ *        changed since the last time
+ * @param installPath path of the hooked executable (i.e. the symlink)
+ * @return the plan (release it with cuckooRelease), or NULL if there's no usable plan
+ */
+tCuckooPlan * cuckooPlan( const char * installPath )
+{
+    char * path = (char *)absolutePath( installPath );
+    if ( path == NULL )
+    {
+        return NULL;
+    }
+
+    tCuckooPlan ** prev = &planCache;
+    for ( tCuckooPlan * plan = planCache; plan != NULL; prev = &plan->next, plan = plan->next )
+    {
+        if ( strcmp( plan->installPath, path ) == 0 )
+        {
+            if ( planIsCurrent( plan ) )
+            {
+                free( path );
+                ++plan->references;
+                return plan;
+            }
+
+            /* stale - drop it from the cache; anyone still using it keeps their reference */
+            *prev = plan->next;
+            cuckooRelease( plan );
+            break;
+        }
+    }
+
+    tCuckooPlan * plan = makePlan( path );
+    if ( plan != NULL )
+    {
+        plan->references = 2;   /* the cache's, and the caller's */
+        plan->next = planCache;
+        planCache  = plan;
+    }
+    return plan;
+}
+
+size_t cuckooPlanSize( const tCuckooPlan * plan )
+{
+    return plan->count;
+}
+
+const tCuckooHook * cuckooPlanHook( const tCuckooPlan * plan, size_t index )
+{
+    return ( index < plan->count ) ? &plan->hooks[ index ] : NULL;
+}
+
+const char * cuckooPlanTarget( const tCuckooPlan * plan )
+{
+    return plan->target;
+}
+
+/**
+ * @brief done with a plan
+ * @param plan
+ */
+void cuckooRelease( tCuckooPlan * plan )
+{
+    if ( plan != NULL && --plan->references == 0 )
+    {
+        freePlan( plan );
+    }
+}
+
+/**
+ * @brief empty the plan cache, e.g. before exiting
+ */
+void cuckooFlushPlans( void )
+{
+    while ( planCache != NULL )
+    {
+        tCuckooPlan * plan = planCache;
+        planCache = plan->next;
+        cuckooRelease( plan );
+    }
+}
+
+/**
+ * @brief run a plan's hooks in order - what invoking the target through its symlink does
+ * @param plan from cuckooPlan()
+ * @param argv the arguments to give each hook. argv[0] is ignored - each hook gets its own path.
+ * @param envp the environment to give each hook
+ * @param callbacks optional, may be NULL
+ * @param results optional - if not NULL, must have room for cuckooPlanSize() results
+ * @return the exit code of the first hook that failed, or 0 if none did
+ */
+int cuckooRun( tCuckooPlan * plan, char * argv[], char * envp[],
+               const tCuckooCallbacks * callbacks, tCuckooResult * results )
+{
+    int result = 0;
+
+    /* each hook gets its own path as argv[0], so work on a copy rather than the caller's */
+    size_t argc = 0;
+    while ( argv[ argc ] != NULL )
+    {
+        ++argc;
+    }
+    char ** args = calloc( argc + 1, sizeof( char * ) );
+    if ( args == NULL )
+    {
+        return reportErrno( "unable to allocate memory" );
+    }
+    memcpy( args, argv, argc * sizeof( char * ) );
+
+    /* in queued mode, wait our turn */
+    uint64_t queued = queueEnter( plan->target, getPriority( plan->target, argv ) );
+    uint32_t flags  = kHistoryChainStart;
+    /* ties together the records of this run of the chain */
+    uint64_t chain  = nowNanoseconds( CLOCK_REALTIME ) ^ ( (uint64_t)getpid() << 40 );
+    /* what earlier hooks have passed on to later ones */
+    tHookVars vars  = { NULL, 0, 0 };
+
+    for ( size_t i = 0; i < plan->count; ++i )
+    {
+        const tCuckooHook * hook = &plan->hooks[i];
+
+        if ( results != NULL )
+        {
+            memset( &results[i], 0, sizeof( tCuckooResult ) );
+        }
+        if ( callbacks != NULL && callbacks->before != NULL && !callbacks->before( callbacks->context, hook ) )
+        {
+            continue;
+        }
+
+        args[0] = (char *)hook->path;
+        tHistoryRecord record;
+        memset( &record, 0, sizeof( record ) );
+        record.magic = kHistoryMagic;
+        record.size  = sizeof( record );
+        record.flags  = flags;
+        record.queued = queued;
+        record.chain  = chain;
+        strncpy( record.target, plan->target, sizeof( record.target ) - 1 );
+        strncpy( record.hook, hook->name, sizeof( record.hook ) - 1 );
+
+        char ** env = ( vars.count > 0 ) ? envWith( envp, vars.vars ) : NULL;
+        if ( env == NULL )
+        {
+            env = envp;
+        }
+
+        if ( !hook->broken && getScopedConfigBool( "hook", hook->name, "windowed", false )
+          && spoolSubmit( plan->installPath, plan->target, hook->name, args, vars.vars, chain ) )
+        {
+            /* it'll run in the maintenance window - the chain carries on without it */
+            if ( env != envp )
+            {
+                free( env );
+            }
+
+            tCuckooResult outcome;
+            memset( &outcome, 0, sizeof( outcome ) );
+            outcome.flags = kCuckooDeferred;
+            outcome.path  = hook->path;
+            if ( results != NULL )
+            {
+                results[i] = outcome;
+            }
+            if ( callbacks != NULL && callbacks->after != NULL )
+            {
+                callbacks->after( callbacks->context, hook, &outcome );
+            }
+            continue;
+        }
+
+        if ( hook->candidate != NULL )
+        {
+            switch ( canaryChoose( record.hook ) )
+            {
+            case kCanaryReplace:
+                {
+                    args[0] = (char *)hook->candidate;
+                    record.flags |= kHistoryCandidate;
+                    const char * name = strrchr( hook->candidate, '/' );
+                    strncpy( record.hook, ( name != NULL ) ? name + 1 : hook->candidate, sizeof( record.hook ) - 1 );
+                }
+                break;
+
+            case kCanaryShadow:
+                launchShadow( args, env, hook->candidate, &record );
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        int res;
+        if ( hook->broken && args[0] == hook->path )
+        {
+            /* don't bother trying to exec it - the outcome is the same as if the exec had failed */
+            res = 127;
+            record.flags |= kHistoryExecFailed;
+            record.status = W_EXITCODE( res, 0 );
+            record.started = nowNanoseconds( CLOCK_REALTIME );
+        }
+        else
+        {
+            res = launch( args, env, hook->name, &record, &vars );
+        }
+        historyAppend( &record );
+        if ( env != envp )
+        {
+            free( env );
+        }
+        flags  = 0;
+        queued = 0;
+        if ( result == 0 && res != 0 )
+        {
+            result = res;
+        }
+
+        tCuckooResult outcome;
+        outcome.ran      = true;
+        outcome.result   = res;
+        outcome.status   = record.status;
+        outcome.duration = record.duration;
+        outcome.flags    = record.flags & ~kHistoryChainStart;
+        outcome.path     = args[0];
+        if ( results != NULL )
+        {
+            results[i] = outcome;
+        }
+        if ( callbacks != NULL && callbacks->after != NULL )
+        {
+            callbacks->after( callbacks->context, hook, &outcome );
+        }
+    }
+
+    freeHookVars( &vars );
+    queueLeave();
+    historyClose();
+    free( args );
+
+    return result;
+}
+
+/**
+ * @brief run a job from the spool, in the child 'cuckoo --drain-spool' forked for it (and
+ *        already running as the job's owner). The job is only trusted to say which of the
+ *        target's hooks to run, and with what arguments - the hook has to be one the target
+ *        actually has, and it gets our environment, plus only what passes for hook data.
+ * @param job
+ * @return the hook's exit code
+ */
+int spoolRunJob( const tSpoolJob * job )
+{
+    extern char ** environ;
+
+    tCuckooPlan * plan = cuckooPlan( job->installPath );
+    const tCuckooHook * hook = NULL;
+    for ( size_t i = 0; plan != NULL && i < plan->count && hook == NULL; ++i )
+    {
+        if ( strcmp( plan->hooks[i].name, job->hook ) == 0 && strcmp( plan->hooks[i].path, job->path ) == 0
+          && strcmp( plan->target, job->target ) == 0 && !plan->hooks[i].broken )
+        {
+            hook = &plan->hooks[i];
+        }
+    }
+    if ( hook == NULL )
+    {
+        syslog( LOG_ERR, "err: \'%s\' isn't one of %s's hooks, so not run", job->path, job->installPath );
+        cuckooRelease( plan );
+        return 126;
+    }
+
+    char ** vars = calloc( job->header.varc + 1, sizeof( char * ) );
+    char ** env  = NULL;
+    if ( vars != NULL )
+    {
+        size_t count = 0;
+        for ( uint32_t i = 0; i < job->header.varc; ++i )
+        {
+            if ( hookVarValid( job->vars[i] ) )
+            {
+                vars[ count++ ] = job->vars[i];
+            }
+        }
+        env = envWith( environ, vars );
+    }
+    if ( env == NULL )
+    {
+        reportErrno( "unable to allocate memory" );
+        free( vars );
+        cuckooRelease( plan );
+        return 127;
+    }
+    job->argv[0] = (char *)hook->path;
+
+    if ( chdir( job->cwd ) != 0 )
+    {
+        syslog( LOG_WARNING, "%s/%s: unable to change to \'%s\' (%m)", job->target, job->hook, job->cwd );
+    }
+
+    tHistoryRecord record;
+    memset( &record, 0, sizeof( record ) );
+    record.magic  = kHistoryMagic;
+    record.size   = sizeof( record );
+    /* not the start of a chain - that was when it was spooled - so 'queued' isn't queue wait */
+    record.flags  = kHistoryDeferred;
+    record.queued = nowNanoseconds( CLOCK_REALTIME ) - job->header.submitted;
+    record.chain  = job->header.chain;
+    strncpy( record.target, job->target, sizeof( record.target ) - 1 );
+    strncpy( record.hook, job->hook, sizeof( record.hook ) - 1 );
+
+    /* there's nothing after it to pass data on to */
+    tHookVars discarded = { NULL, 0, 0 };
+    int result = launch( job->argv, env, hook->name, &record, &discarded );
+    freeHookVars( &discarded );
+    free( env );
+    free( vars );
+    cuckooRelease( plan );
+
+    historyAppend( &record );
+    historyClose();
+    return result;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file libcuckoo.h
+ *
+ * Running a target's hook chain from within another program, without exec'ing
+ * it through the impersonating symlink. This is the same code the symlink runs,
+ * so everything configured for the target applies: queueing, history, progress,
+ * timeouts, the file descriptor policy, canaries and data passed between hooks.
+ *
+ *     tCuckooPlan * plan = cuckooPlan( "/usr/share/channels-dvr/latest/comskip" );
+ *     if ( plan != NULL )
+ *     {
+ *         int result = cuckooRun( plan, argv, envp, NULL, NULL );
+ *         cuckooRelease( plan );
+ *     }
+ *
+ * A plan is the sorted list of hooks to run, found by scanning the target's
+ * directories. Plans are cached: asking for the same target again returns the
+ * cached plan as long as neither directory has changed since it was scanned, so
+ * a long-lived program only pays for the scan when hooks are added or removed.
+ *
+ * Not thread-safe - calls must be serialized by the caller.
+ *
+ * MIT Licensed
+ */
+
+#ifndef LIBCUCKOO_H
+#define LIBCUCKOO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define kCuckooApiVersion       1
+
+/* the library is built with everything hidden but these */
+#define CUCKOO_API              __attribute__(( visibility( "default" ) ))
+
+/* tCuckooResult.flags */
+#define kCuckooTimedOut         (1 << 1)    /* killed for exceeding its timeout */
+#define kCuckooHeartbeatLost    (1 << 2)    /* killed for not sending heartbeats */
+#define kCuckooExecFailed       (1 << 3)    /* couldn't be executed, or verification found it broken */
+#define kCuckooCandidate        (1 << 4)    /* its '.canary' version ran instead */
+#define kCuckooDeferred         (1 << 6)    /* 'windowed' - spooled to run in the maintenance window */
+
+typedef struct sCuckooPlan tCuckooPlan;
+
+typedef struct {
+    const char * name;          /* the file name, e.g. '50-comskip' */
+    const char * path;
+    const char * candidate;     /* path of its '.canary' version, or NULL */
+    bool         broken;        /* verification found it broken - it won't be run */
+} tCuckooHook;
+
+typedef struct {
+    bool         ran;           /* false if the 'before' callback skipped it, or it was deferred */
+    int          result;        /* exit code, or 128 + the signal that killed it */
+    int          status;        /* as returned by waitpid() */
+    uint64_t     duration;      /* nanoseconds */
+    uint32_t     flags;
+    const char * path;          /* what actually ran - the candidate, in canary mode */
+} tCuckooResult;
+
+typedef struct {
+    /* called before each hook is run. Return false to skip it. */
+    bool (* before)( void * context, const tCuckooHook * hook );
+    /* called after each hook has run */
+    void (* after)(  void * context, const tCuckooHook * hook, const tCuckooResult * result );
+    void * context;
+} tCuckooCallbacks;
+
+CUCKOO_API int                 cuckooApiVersion( void );
+
+CUCKOO_API tCuckooPlan *       cuckooPlan(     const char * installPath );
+CUCKOO_API size_t              cuckooPlanSize( const tCuckooPlan * plan );
+CUCKOO_API const tCuckooHook * cuckooPlanHook( const tCuckooPlan * plan, size_t index );
+CUCKOO_API const char *        cuckooPlanTarget( const tCuckooPlan * plan );
+
+CUCKOO_API int                 cuckooRun(      tCuckooPlan * plan, char * argv[], char * envp[],
+                                               const tCuckooCallbacks * callbacks, tCuckooResult * results );
+
+CUCKOO_API void                cuckooRelease(  tCuckooPlan * plan );
+CUCKOO_API void                cuckooFlushPlans( void );
+
+#endif /* LIBCUCKOO_H */
@@ -0,0 +1,415 @@
+/**
+ * @file metrics.c
+ *
+ * 'cuckoo --metrics' - the history, running hooks and the queue state, in the Prometheus
+ * text exposition format, e.g. for node_exporter's textfile collector.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "queue.h"
+#include "progress.h"
+#include "spool.h"
+#include "metrics.h"
+
+static const unsigned int quantiles[] = { 50, 90, 99 };
+
+/**
+ * @brief print a label value, escaped as the exposition format requires
+ */
+static void printLabel( const char * value )
+{
+    for ( const char * p = value; *p != '\0'; ++p )
+    {
+        switch ( *p )
+        {
+        case '\\': fputs( "\\\\", stdout ); break;
+        case '"':  fputs( "\\\"", stdout ); break;
+        case '\n': fputs( "\\n",  stdout ); break;
+        default:   putchar( *p );          break;
+        }
+    }
+}
+
+static void printLabels( const char * target, const char * hook )
+{
+    fputs( "{target=\"", stdout );
+    printLabel( target );
+    if ( hook != NULL )
+    {
+        fputs( "\",hook=\"", stdout );
+        printLabel( hook );
+    }
+    fputs( "\"", stdout );
+}
+
+static void printHeader( const char * name, const char * type, const char * help )
+{
+    printf( "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+}
+
+/**
+ * @brief print a summary (quantiles, sum and count) of a set of durations, in seconds
+ * @param name metric name
+ * @param target
+ * @param hook may be NULL
+ * @param durations nanoseconds - sorted by this function
+ * @param count
+ */
+static void printSummary( const char * name, const char * target, const char * hook,
+                          uint64_t * durations, size_t count )
+{
+    uint64_t sum = 0;
+
+    qsort( durations, count, sizeof( uint64_t ), compareDurations );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        sum += durations[i];
+    }
+
+    for ( size_t q = 0; q < sizeof( quantiles ) / sizeof( quantiles[0] ); ++q )
+    {
+        fputs( name, stdout );
+        printLabels( target, hook );
+        printf( ",quantile=\"0.%02u\"} %.3f\n", quantiles[q],
+                historyPercentile( durations, count, quantiles[q] ) / 1e9 );
+    }
+    printf( "%s_sum", name );
+    printLabels( target, hook );
+    printf( "} %.3f\n", sum / 1e9 );
+    printf( "%s_count", name );
+    printLabels( target, hook );
+    printf( "} %zu\n", count );
+}
+
+/**
+ * @brief hook latency and failures, and queue wait times, over the window
+ */
+static void historyMetrics( tHistory * history )
+{
+    uint64_t * durations = malloc( ( history->count + 1 ) * sizeof( uint64_t ) );
+    if ( durations == NULL )
+    {
+        return;
+    }
+
+    qsort( history->records, history->count, sizeof( tHistoryRecord ), compareHistoryRecords );
+
+    printHeader( "cuckoo_hook_failures", "gauge", "Hook executions within the window that failed." );
+    for ( size_t start = 0, i = 1; i <= history->count; ++i )
+    {
+        const tHistoryRecord * first = &history->records[ start ];
+        if ( i == history->count
+          || strcmp( history->records[i].target, first->target ) != 0
+          || strcmp( history->records[i].hook,   first->hook )   != 0 )
+        {
+            size_t failures = 0;
+            for ( size_t j = start; j < i; ++j )
+            {
+                failures += hookFailed( &history->records[j] );
+            }
+            fputs( "cuckoo_hook_failures", stdout );
+            printLabels( first->target, first->hook );
+            printf( "} %zu\n", failures );
+            start = i;
+        }
+    }
+
+    printHeader( "cuckoo_hook_timeouts", "gauge", "Hook executions within the window killed by a timeout or lost heartbeat." );
+    for ( size_t start = 0, i = 1; i <= history->count; ++i )
+    {
+        const tHistoryRecord * first = &history->records[ start ];
+        if ( i == history->count
+          || strcmp( history->records[i].target, first->target ) != 0
+          || strcmp( history->records[i].hook,   first->hook )   != 0 )
+        {
+            size_t killed = 0;
+            for ( size_t j = start; j < i; ++j )
+            {
+                killed += ( history->records[j].flags & ( kHistoryTimedOut | kHistoryHeartbeatLost ) ) != 0;
+            }
+            fputs( "cuckoo_hook_timeouts", stdout );
+            printLabels( first->target, first->hook );
+            printf( "} %zu\n", killed );
+            start = i;
+        }
+    }
+
+    printHeader( "cuckoo_hook_duration_seconds", "summary", "Hook execution latency within the window." );
+    for ( size_t start = 0, i = 1; i <= history->count; ++i )
+    {
+        const tHistoryRecord * first = &history->records[ start ];
+        if ( i == history->count
+          || strcmp( history->records[i].target, first->target ) != 0
+          || strcmp( history->records[i].hook,   first->hook )   != 0 )
+        {
+            size_t count = 0;
+            for ( size_t j = start; j < i; ++j )
+            {
+                durations[ count++ ] = history->records[j].duration;
+            }
+            printSummary( "cuckoo_hook_duration_seconds", first->target, first->hook, durations, count );
+            start = i;
+        }
+    }
+
+    printHeader( "cuckoo_queue_wait_seconds", "summary", "Time hook chains waited for a slot in queued mode, within the window." );
+    for ( size_t start = 0, i = 1; i <= history->count; ++i )
+    {
+        const tHistoryRecord * first = &history->records[ start ];
+        if ( i == history->count || strcmp( history->records[i].target, first->target ) != 0 )
+        {
+            size_t count = 0;
+            for ( size_t j = start; j < i; ++j )
+            {
+                /* older deferred records were flagged as starting a chain too */
+                if ( ( history->records[j].flags & ( kHistoryChainStart | kHistoryDeferred ) ) == kHistoryChainStart )
+                {
+                    durations[ count++ ] = history->records[j].queued;
+                }
+            }
+            if ( count > 0 )
+            {
+                printSummary( "cuckoo_queue_wait_seconds", first->target, NULL, durations, count );
+            }
+            start = i;
+        }
+    }
+
+    printHeader( "cuckoo_spool_wait_seconds", "summary", "Time windowed hooks waited in the spool before running, within the window." );
+    for ( size_t start = 0, i = 1; i <= history->count; ++i )
+    {
+        const tHistoryRecord * first = &history->records[ start ];
+        if ( i == history->count
+          || strcmp( history->records[i].target, first->target ) != 0
+          || strcmp( history->records[i].hook,   first->hook )   != 0 )
+        {
+            size_t count = 0;
+            for ( size_t j = start; j < i; ++j )
+            {
+                if ( history->records[j].flags & kHistoryDeferred )
+                {
+                    durations[ count++ ] = history->records[j].queued;
+                }
+            }
+            if ( count > 0 )
+            {
+                printSummary( "cuckoo_spool_wait_seconds", first->target, first->hook, durations, count );
+            }
+            start = i;
+        }
+    }
+
+    free( durations );
+}
+
+typedef enum {
+    kProgressPercent,
+    kHeartbeatAge,
+    kRunningTime
+} tProgressMetric;
+
+static bool printProgress( const tHookStatus * status, void * context )
+{
+    static const char * names[] = {
+        "cuckoo_hook_progress_percent",
+        "cuckoo_hook_heartbeat_age_seconds",
+        "cuckoo_hook_running_seconds"
+    };
+    tProgressMetric metric = *(tProgressMetric *)context;
+    double          value;
+
+    switch ( metric )
+    {
+    case kProgressPercent: value = status->progress;     break;
+    case kHeartbeatAge:    value = status->heartbeatAge; break;
+    default:               value = status->elapsed;      break;
+    }
+
+    if ( value >= 0.0 )
+    {
+        fputs( names[ metric ], stdout );
+        printLabels( status->target, status->hook );
+        printf( ",pid=\"%d\"} %.1f\n", status->hookPid, value );
+    }
+    return true;
+}
+
+/**
+ * @brief the progress and heartbeats of the hooks running right now
+ */
+static void progressMetrics( void )
+{
+    tProgressMetric metric;
+
+    printHeader( "cuckoo_hook_progress_percent", "gauge", "Progress last reported by a running hook." );
+    metric = kProgressPercent;
+    readHookStatus( printProgress, &metric );
+
+    printHeader( "cuckoo_hook_heartbeat_age_seconds", "gauge", "Time since a running hook last reported progress or a heartbeat." );
+    metric = kHeartbeatAge;
+    readHookStatus( printProgress, &metric );
+
+    printHeader( "cuckoo_hook_running_seconds", "gauge", "Time a running hook has been running." );
+    metric = kRunningTime;
+    readHookStatus( printProgress, &metric );
+}
+
+/**
+ * @brief the live state of the queue, if queued mode is in use
+ */
+static void queueMetrics( void )
+{
+    tQueueState * state = queueAttach( true );
+
+    /* the adaptive limit, if the leader is adjusting it */
+    printHeader( "cuckoo_queue_limit", "gauge", "Maximum number of concurrent hook chains (0 is unlimited)." );
+    printf( "cuckoo_queue_limit %ld\n", ( state != NULL && state->limit > 0 )
+                                        ? (long)state->limit : getConfigNumber( "queue.limit", 0 ) );
+    if ( state == NULL )
+    {
+        return;
+    }
+
+    printHeader( "cuckoo_queue_completed_total", "counter", "Hook chains that have run in queued mode." );
+    printf( "cuckoo_queue_completed_total %llu\n", (unsigned long long)state->completed );
+
+    uint64_t now = nowNanoseconds( CLOCK_MONOTONIC );
+
+    unsigned int waiting[ kQueueTargets ] = { 0 };
+    unsigned int running[ kQueueTargets ] = { 0 };
+    uint64_t     oldest[ kQueueTargets ]  = { 0 };
+
+    for ( int i = 0; i < kQueueEntries; ++i )
+    {
+        const tQueueEntry * entry = &state->entries[i];
+        if ( entry->target >= kQueueTargets )
+        {
+            continue;
+        }
+        switch ( entry->state )
+        {
+        case kEntryWaiting:
+            ++waiting[ entry->target ];
+            if ( now > entry->enqueued && now - entry->enqueued > oldest[ entry->target ] )
+            {
+                oldest[ entry->target ] = now - entry->enqueued;
+            }
+            break;
+
+        case kEntryRunning:
+            ++running[ entry->target ];
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    printHeader( "cuckoo_queue_waiting", "gauge", "Hook chains currently waiting for a slot." );
+    for ( int i = 0; i < kQueueTargets; ++i )
+    {
+        if ( state->targets[i].name[0] != '\0' )
+        {
+            fputs( "cuckoo_queue_waiting", stdout );
+            printLabels( state->targets[i].name, NULL );
+            printf( "} %u\n", waiting[i] );
+        }
+    }
+
+    printHeader( "cuckoo_queue_running", "gauge", "Hook chains currently running in queued mode." );
+    for ( int i = 0; i < kQueueTargets; ++i )
+    {
+        if ( state->targets[i].name[0] != '\0' )
+        {
+            fputs( "cuckoo_queue_running", stdout );
+            printLabels( state->targets[i].name, NULL );
+            printf( "} %u\n", running[i] );
+        }
+    }
+
+    printHeader( "cuckoo_queue_oldest_wait_seconds", "gauge", "How long the longest-waiting hook chain has waited so far." );
+    for ( int i = 0; i < kQueueTargets; ++i )
+    {
+        if ( state->targets[i].name[0] != '\0' )
+        {
+            fputs( "cuckoo_queue_oldest_wait_seconds", stdout );
+            printLabels( state->targets[i].name, NULL );
+            printf( "} %.3f\n", oldest[i] / 1e9 );
+        }
+    }
+
+    printHeader( "cuckoo_queue_leader", "gauge", "Whether a queue leader is currently granting slots." );
+    printf( "cuckoo_queue_leader %d\n", state->leader > 0 && kill( state->leader, 0 ) == 0 );
+
+    queueDetach( state );
+}
+
+/**
+ * @brief the backlog of windowed hooks waiting to be run
+ */
+static void spoolMetrics( void )
+{
+    uint64_t oldest  = 0;
+    int      backlog = spoolBacklog( &oldest );
+
+    printHeader( "cuckoo_spool_backlog", "gauge", "Windowed hook jobs waiting in the spool." );
+    printf( "cuckoo_spool_backlog %d\n", backlog );
+
+    printHeader( "cuckoo_spool_oldest_seconds", "gauge", "How long the oldest spooled job has waited so far." );
+    printf( "cuckoo_spool_oldest_seconds %.3f\n", oldest / 1e9 );
+}
+
+/**
+ * @brief implements 'cuckoo --metrics [--window <duration>]'
+ * @param argc
+ * @param argv the arguments following '--metrics'
+ * @return exit code
+ */
+int showMetrics( int argc, char * argv[] )
+{
+    long window = 60 * 60;
+
+    for ( int i = 0; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "--window" ) == 0 && i + 1 < argc )
+        {
+            window = parseDuration( argv[++i], -1 );
+            if ( window < 0 )
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            reportError( "unexpected argument \'%s\'", argv[i] );
+            return -1;
+        }
+    }
+
+    tHistory history = { NULL, 0, 0 };
+    uint64_t since   = nowNanoseconds( CLOCK_REALTIME ) - (uint64_t)window * 1000000000;
+    if ( getConfigString( "history.file", kHistoryPath )[0] != '\0'
+      && loadHistory( &history, since, NULL ) == 0 )
+    {
+        historyMetrics( &history );
+    }
+    freeHistory( &history );
+
+    progressMetrics();
+    queueMetrics();
+    spoolMetrics();
+
+    return 0;
+}
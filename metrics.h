@@ -0,0 +1,15 @@
+/**
+ * @file metrics.h
+ *
+ * 'cuckoo --metrics' - the history and the live queue state, in the Prometheus
+ * text exposition format, e.g. for node_exporter's textfile collector.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_METRICS_H
+#define CUCKOO_METRICS_H
+
+int showMetrics( int argc, char * argv[] );
+
+#endif /* CUCKOO_METRICS_H */
@@ -0,0 +1,313 @@
+/**
+ * @file paths.c
+ *
+ * Where things live.
+ *
+ * Created by Paul Chambers on 5/3/21.
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <libgen.h>
+#include <linux/limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "report.h"
+#include "config.h"
+#include "paths.h"
+
+/**
+ * @brief
+ * @param path
+ * @return
+ */
+const char * absolutePath( const char * path )
+{
+    char * result = NULL;
+    struct stat pathInfo;
+    char * dir;
+    char * directory;
+    char * filename;
+
+    if( lstat( path, &pathInfo ) != 0 )
+    {
+        reportErrno( "unable to get information about \'%s\'", path );
+        return NULL;
+    }
+
+    switch ( pathInfo.st_mode & S_IFMT )
+    {
+    case S_IFLNK:
+        {
+            char * copy = strdup( path );
+            if ( copy != NULL )
+            {
+                filename = strrchr( copy, '/' );
+                if ( filename == NULL )
+                {
+                    /* no slash, just the filename */
+                    dir = "./";
+                    filename = copy;
+                }
+                else
+                {
+                    dir = copy;
+                    *filename++ = '\0';
+                }
+
+                directory = realpath( dir, NULL);
+                if ( directory != NULL )
+                {
+                    asprintf( &result, "%s/%s", directory, filename );
+                    free( directory );
+                }
+
+                free( copy );
+            }
+
+        }
+        break;
+
+    case S_IFREG:
+    case S_IFDIR:
+        result = realpath( path, NULL );
+        break;
+
+    default:
+        /* whatever it is, we don't support it */
+        reportError( "\'%s\' isn't supported", path );
+        result = NULL;
+        break;
+    }
+
+    return result;
+}
+
+/**
+ * @brief
+ * @param path
+ * @return
+ */
+const char * basenamedup( const char * path )
+{
+    char * result = NULL;
+
+    char * lastSlash = strrchr( path,'/' );
+    if ( lastSlash != NULL)
+    {
+        result = strdup( lastSlash + 1 );
+    }
+    else
+    {
+        result = strdup( path );
+    }
+
+    return result;
+}
+
+/**
+ * @brief creates all directories of a path that are missing (like mkdir -p)
+ * @param path
+ * @return
+ */
+static int mkDirRecurse( const char * path )
+{
+    int result;
+    struct stat   dirStat;
+
+    if ( stat( path, &dirStat ) != 0 )
+    {
+        if (errno == ENOENT)
+        {
+            char * parent = strdup( path );
+            result = mkDirRecurse( dirname( parent ) );
+            free( parent );
+            if (result == 0)
+            {
+                result = mkdir( path, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+                if ( result != 0 )
+                {
+                    reportErrno( "unable to create directory \'%s\'", path );
+                }
+            }
+            return result;
+        }
+        else
+        {
+            return reportErrno( "unable to get information about \'%s\'", path );
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ * @param path
+ * @return
+ */
+const char * makeDirectory( const char * path )
+{
+    const char *  result = NULL;
+    struct stat   dirStat;
+
+    /* does the script directory already exist? */
+    if ( stat( path, &dirStat ) == 0 )
+    {
+        if ( S_ISDIR(dirStat.st_mode ) )
+        {
+            result = path;
+        }
+        else
+        {
+            /* something there already, but it's not a directory */
+            reportErrno( "\'%s\' exists, but is not a directory", path );
+        }
+    }
+    else
+    {
+        /* stat() failed */
+        if ( errno != ENOENT )
+        {
+            /* report anything other than the expected 'not found' */
+            reportErrno( "unable to get info about \'%s\'", path );
+        }
+        else if ( mkDirRecurse( path ) == 0 )
+        {
+            result = path;
+        }
+    }
+    return ( result != NULL ) ? strdup( result ) : NULL;
+}
+
+/**
+ * @brief
+ * @param absPathFrom
+ * @param absPathTo
+ * @return
+ */
+const char * makeSymlink( const char * absPathFrom, const char * absPathTo )
+{
+    const char *  result = NULL;
+    struct stat   dirStat;
+
+    debugf("from: \'%s\' to: \'%s\'", absPathFrom, absPathTo );
+    /* does the link to the script directory already exist? */
+    if ( stat( absPathFrom, &dirStat ) == 0 )
+    {
+        if ( S_ISLNK( dirStat.st_mode ) )
+        {
+            /* a symlink exists, we're good. */
+            result = absPathFrom;
+        }
+        else
+        {
+            /* something there already, but it's not a symbolic link */
+            reportErrno( "\'%s\' exists, but is not a symbolic link", absPathFrom );
+        }
+    }
+    else
+    {
+        /* stat() failed */
+        if ( errno != ENOENT )
+        {
+            /* report anything other than the expected 'not found' */
+            reportErrno( "unable to get info about \'%s\'", absPathFrom );
+        }
+        else if ( symlink( absPathFrom, absPathTo ) != 0 )
+        {
+            reportErrno( "failed to create a symbolic link from \'%s\' to \'%s\'", absPathFrom, absPathTo );
+        }
+        else
+        {
+            /* successfully created the symlink */
+            result = absPathFrom;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief
+ * @param scriptsDir
+ * @return
+ */
+const char * getScriptsDir( const char * absPath )
+{
+    const char *  result = NULL;
+
+    char * dir = strdup( absPath );
+    if ( dir != NULL )
+    {
+        char * base = strrchr( dir, '/' );
+        if ( base != NULL)
+        {
+            *base++ = '\0';
+
+            char * scriptsDir = NULL;
+            asprintf( &scriptsDir, "%s/.%s.d", dir, base );
+            if ( scriptsDir != NULL )
+            {
+                result = makeDirectory( scriptsDir );
+                free( scriptsDir );
+            }
+        }
+        free( dir );
+    }
+
+    return result;
+}
+
+/**
+ * @brief
+ * @param scriptsDir
+ * @return
+ */
+const char * getCommonDir( const char * absPath )
+{
+    const char *  result = NULL;
+
+    char * dir = strdup( absPath );
+    if ( dir != NULL )
+    {
+        char * base = strrchr( dir, '/' );
+        if ( base != NULL)
+        {
+            *base++ = '\0';
+
+            char * commonDir = NULL;
+            asprintf( &commonDir, "%s/%s", getConfigString( "commonDir", kCommonDir ), base );
+            if ( commonDir != NULL )
+            {
+                result = makeDirectory( commonDir );
+                free( commonDir );
+            }
+        }
+        free( dir );
+    }
+
+    return result;
+}
+
+/**
+ * @brief get the full path to ourselves
+ * @return absolute path to the executable used to create this process (caller should free)
+ */
+const char * getPathToSelf( void )
+{
+    /* figure out the absolute path to this executable */
+    char temp[PATH_MAX + 1];
+    temp[0] = '\0';
+    int len = readlink( "/proc/self/exe", temp, sizeof(temp));
+    if ( len >= 0 )
+    {
+        temp[len] = '\0';
+    }
+    return strdup( temp );
+};
+
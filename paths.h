@@ -0,0 +1,24 @@
+/**
+ * @file paths.h
+ *
+ * Where things live: the hooked target, its script directory beside it and its
+ * common directory under /etc/cuckoo, which survives the target being replaced.
+ *
+ * Created by Paul Chambers on 5/3/21.
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_PATHS_H
+#define CUCKOO_PATHS_H
+
+#define kCommonDir      "/etc/cuckoo"   /* hooks that survive the target being replaced live below here */
+
+const char * absolutePath(  const char * path );
+const char * basenamedup(   const char * path );
+const char * makeDirectory( const char * path );
+const char * makeSymlink(   const char * absPathFrom, const char * absPathTo );
+const char * getScriptsDir( const char * absPath );
+const char * getCommonDir(  const char * absPath );
+const char * getPathToSelf( void );
+
+#endif /* CUCKOO_PATHS_H */
@@ -0,0 +1,426 @@
+/**
+ * @file progress.c
+ *
+ * A lightweight progress channel for long-running hooks, and the status files
+ * that describe every running hook.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <syslog.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "fdpolicy.h"
+#include "progress.h"
+
+#define kStatusInterval     1000000000ULL   /* rewrite the status file at most once a second */
+
+/**
+ * @brief
+ * @return the directory for status files, creating it if necessary, or NULL if disabled
+ */
+static const char * getStatusDir( void )
+{
+    const char * dir = getConfigString( "status.dir", kStatusDir );
+    if ( *dir == '\0' )
+    {
+        return NULL;
+    }
+
+    if ( mkdir( dir, 01777 ) == 0 )
+    {
+        /* every user that might run a hook chain needs to be able to create files here, like /tmp */
+        chmod( dir, 01777 );
+    }
+    return dir;
+}
+
+/**
+ * @brief (re)write the status file, via a temporary file so readers never see a partial one
+ * @param progress
+ */
+static void writeStatus( tProgress * progress )
+{
+    if ( progress->statusPath == NULL )
+    {
+        return;
+    }
+
+    /* the directory is world-writable, so a fixed temporary name could be planted (e.g. as a
+     * symlink) by someone else - let mkostemp() pick one that's ours. The '.' hides it from
+     * readHookStatus(). */
+    char * tempPath = NULL;
+    asprintf( &tempPath, "%s.XXXXXX", progress->statusPath );
+    if ( tempPath == NULL )
+    {
+        return;
+    }
+
+    int fd = mkostemp( tempPath, O_CLOEXEC );
+    if ( fd >= 0 )
+    {
+        /* readable by 'cuckoo --status' and '--metrics', whoever runs them */
+        fchmod( fd, 0644 );
+        dprintf( fd, "pid=%d\n"
+                     "hookPid=%d\n"
+                     "target=%s\n"
+                     "hook=%s\n"
+                     "started=%llu\n"
+                     "heartbeat=%llu\n"
+                     "progress=%.1f\n"
+                     "message=%s\n",
+                 getpid(), progress->pid, progress->target, progress->hook,
+                 (unsigned long long)progress->started,
+                 (unsigned long long)progress->heartbeat,
+                 progress->progress, progress->message );
+        close( fd );
+
+        if ( rename( tempPath, progress->statusPath ) != 0 )
+        {
+            unlink( tempPath );
+        }
+    }
+    free( tempPath );
+
+    progress->written = nowNanoseconds( CLOCK_MONOTONIC );
+}
+
+/**
+ * @brief create the pipe the hook will report its progress through, if it has 'progress = on'
+ *        or a heartbeat timeout. Its status file is published either way.
+ * @param progress
+ * @param target
+ * @param hook
+ * @return true if the channel is ready
+ */
+bool progressOpen( tProgress * progress, const char * target, const char * hook )
+{
+    int fds[2];
+
+    memset( progress, 0, sizeof( tProgress ) );
+    progress->readFd   = -1;
+    progress->writeFd  = -1;
+    progress->progress = -1.0;
+    progress->target   = target;
+    progress->hook     = hook;
+    progress->started  = nowNanoseconds( CLOCK_MONOTONIC );
+    progress->heartbeat = progress->started;
+
+    /* opt-in, as only a hook written to report progress needs it - and the shim can't provide it */
+    if ( !getScopedConfigBool( "hook", hook, "progress", false )
+      && getScopedConfigString( "hook", hook, "heartbeatTimeout", NULL ) == NULL )
+    {
+        return false;
+    }
+    if ( pipeAboveStdio( fds ) != 0 )
+    {
+        syslog( LOG_WARNING, "unable to create a progress channel for \'%s\' (%m)", hook );
+        return false;
+    }
+
+    /* only our end is non-blocking - a hook writing to a full pipe should simply wait */
+    fcntl( fds[0], F_SETFL, fcntl( fds[0], F_GETFL ) | O_NONBLOCK );
+
+    progress->readFd  = fds[0];
+    progress->writeFd = fds[1];
+    return true;
+}
+
+/**
+ * @brief the hook has been launched, so close our copy of its end of the pipe, and publish its status
+ * @param progress
+ * @param pid
+ */
+void progressStarted( tProgress * progress, pid_t pid )
+{
+    if ( progress->writeFd >= 0 )
+    {
+        close( progress->writeFd );
+        progress->writeFd = -1;
+    }
+
+    progress->pid = pid;
+
+    const char * dir = getStatusDir();
+    if ( dir != NULL && pid > 0 )
+    {
+        asprintf( &progress->statusPath, "%s/%d", dir, pid );
+        writeStatus( progress );
+    }
+}
+
+/**
+ * @brief handle one complete line received from the hook
+ */
+static void progressLine( tProgress * progress, char * line )
+{
+    progress->heartbeat = nowNanoseconds( CLOCK_MONOTONIC );
+
+    while ( isspace( (unsigned char)*line ) )
+    {
+        ++line;
+    }
+
+    if ( strncmp( line, "progress=", 9 ) == 0 )
+    {
+        char * end;
+        double value = strtod( line + 9, &end );
+        if ( end != line + 9 )
+        {
+            if ( value < 0.0 )   value = 0.0;
+            if ( value > 100.0 ) value = 100.0;
+
+            if ( (int)( value / 10 ) != (int)( progress->progress / 10 ) )
+            {
+                syslog( LOG_DEBUG, "%s/%s: %.0f%%", progress->target, progress->hook, value );
+            }
+            progress->progress = value;
+        }
+    }
+    else if ( strncmp( line, "status=", 7 ) == 0 )
+    {
+        /* keep the status file line-oriented */
+        for ( char * p = line + 7; *p != '\0'; ++p )
+        {
+            if ( *p == '\r' ) *p = ' ';
+        }
+        strncpy( progress->message, line + 7, sizeof( progress->message ) - 1 );
+        syslog( LOG_DEBUG, "%s/%s: %s", progress->target, progress->hook, progress->message );
+    }
+}
+
+/**
+ * @brief consume whatever the hook has written to the channel so far
+ * @param progress
+ */
+void progressRead( tProgress * progress )
+{
+    while ( progress->readFd >= 0 )
+    {
+        ssize_t len = read( progress->readFd, progress->buffer + progress->used,
+                            sizeof( progress->buffer ) - 1 - progress->used );
+        if ( len < 0 && ( errno == EAGAIN || errno == EINTR ) )
+        {
+            break;
+        }
+        if ( len <= 0 )
+        {
+            /* the hook (and anything it started) closed its end */
+            close( progress->readFd );
+            progress->readFd = -1;
+            break;
+        }
+
+        progress->used += len;
+        progress->buffer[ progress->used ] = '\0';
+
+        char * line = progress->buffer;
+        char * newline;
+        while ( ( newline = strchr( line, '\n' ) ) != NULL )
+        {
+            *newline = '\0';
+            progressLine( progress, line );
+            line = newline + 1;
+        }
+
+        progress->used -= line - progress->buffer;
+        memmove( progress->buffer, line, progress->used );
+        if ( progress->used >= sizeof( progress->buffer ) - 1 )
+        {
+            /* an absurdly long line - drop it */
+            progress->used = 0;
+        }
+    }
+
+    if ( nowNanoseconds( CLOCK_MONOTONIC ) - progress->written >= kStatusInterval )
+    {
+        writeStatus( progress );
+    }
+}
+
+/**
+ * @brief the hook has exited - tidy up
+ * @param progress
+ */
+void progressClose( tProgress * progress )
+{
+    if ( progress->readFd >= 0 )
+    {
+        close( progress->readFd );
+        progress->readFd = -1;
+    }
+    if ( progress->writeFd >= 0 )
+    {
+        close( progress->writeFd );
+        progress->writeFd = -1;
+    }
+    if ( progress->statusPath != NULL )
+    {
+        unlink( progress->statusPath );
+        free( progress->statusPath );
+        progress->statusPath = NULL;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief parse one status file
+ * @return true if it describes a hook that is still running
+ */
+static bool parseStatus( const char * path, tHookStatus * status )
+{
+    FILE * file = fopen( path, "re" );
+    if ( file == NULL )
+    {
+        return false;
+    }
+
+    unsigned long long started = 0, heartbeat = 0;
+
+    memset( status, 0, sizeof( tHookStatus ) );
+    status->progress = -1.0;
+
+    char line[ 256 ];
+    while ( fgets( line, sizeof( line ), file ) != NULL )
+    {
+        line[ strcspn( line, "\n" ) ] = '\0';
+
+        char * value = strchr( line, '=' );
+        if ( value == NULL )
+        {
+            continue;
+        }
+        *value++ = '\0';
+
+        if      ( strcmp( line, "pid" )       == 0 ) status->pid     = atoi( value );
+        else if ( strcmp( line, "hookPid" )   == 0 ) status->hookPid = atoi( value );
+        else if ( strcmp( line, "started" )   == 0 ) started         = strtoull( value, NULL, 10 );
+        else if ( strcmp( line, "heartbeat" ) == 0 ) heartbeat       = strtoull( value, NULL, 10 );
+        else if ( strcmp( line, "progress" )  == 0 ) status->progress = strtod( value, NULL );
+        else if ( strcmp( line, "target" )    == 0 ) strncpy( status->target,  value, sizeof( status->target )  - 1 );
+        else if ( strcmp( line, "hook" )      == 0 ) strncpy( status->hook,    value, sizeof( status->hook )    - 1 );
+        else if ( strcmp( line, "message" )   == 0 ) strncpy( status->message, value, sizeof( status->message ) - 1 );
+    }
+    fclose( file );
+
+    if ( status->pid <= 0 || ( kill( status->pid, 0 ) != 0 && errno == ESRCH ) )
+    {
+        /* left behind by an invocation that was killed */
+        unlink( path );
+        return false;
+    }
+
+    uint64_t now = nowNanoseconds( CLOCK_MONOTONIC );
+    status->elapsed      = ( now > started )   ? ( now - started )   / 1e9 : 0.0;
+    status->heartbeatAge = ( now > heartbeat ) ? ( now - heartbeat ) / 1e9 : 0.0;
+    return true;
+}
+
+/**
+ * @brief call 'callback' for every hook that is currently running
+ * @param callback return false to stop
+ * @param context passed through to callback
+ * @return 0, or an errno value if the status directory can't be read
+ */
+int readHookStatus( bool (* callback)( const tHookStatus * status, void * context ), void * context )
+{
+    const char * dir = getConfigString( "status.dir", kStatusDir );
+    if ( *dir == '\0' )
+    {
+        return 0;
+    }
+
+    DIR * dirp = opendir( dir );
+    if ( dirp == NULL )
+    {
+        return ( errno == ENOENT ) ? 0 : reportErrno( "unable to read \'%s\'", dir );
+    }
+
+    struct dirent * entry;
+    while ( ( entry = readdir( dirp ) ) != NULL )
+    {
+        /* status files are named after the hook's pid; skip '.', '..' and temporary files */
+        if ( !isdigit( (unsigned char)entry->d_name[0] ) || strchr( entry->d_name, '.' ) != NULL )
+        {
+            continue;
+        }
+
+        char * path = NULL;
+        asprintf( &path, "%s/%s", dir, entry->d_name );
+        if ( path != NULL )
+        {
+            tHookStatus status;
+            bool more = !parseStatus( path, &status ) || callback( &status, context );
+            free( path );
+            if ( !more )
+            {
+                break;
+            }
+        }
+    }
+    closedir( dirp );
+
+    return 0;
+}
+
+static bool printStatus( const tHookStatus * status, void * context )
+{
+    int * count = context;
+
+    if ( (*count)++ == 0 )
+    {
+        printf( "%7s %7s %-16s %-28s %9s %8s %9s  %s\n",
+                "pid", "hookpid", "target", "hook", "elapsed", "progress", "heartbeat", "status" );
+    }
+
+    char progress[16] = "-";
+    if ( status->progress >= 0.0 )
+    {
+        snprintf( progress, sizeof( progress ), "%.1f%%", status->progress );
+    }
+
+    printf( "%7d %7d %-16s %-28s %8.0fs %8s %8.0fs  %s\n",
+            status->pid, status->hookPid, status->target, status->hook,
+            status->elapsed, progress, status->heartbeatAge, status->message );
+    return true;
+}
+
+/**
+ * @brief implements 'cuckoo --status'
+ * @param argc
+ * @param argv the arguments following '--status'
+ * @return exit code
+ */
+int showStatus( int argc, char * argv[] )
+{
+    int count = 0;
+
+    if ( argc > 0 )
+    {
+        reportError( "unexpected argument \'%s\'", argv[0] );
+        return -1;
+    }
+
+    int result = readHookStatus( printStatus, &count );
+    if ( result == 0 && count == 0 )
+    {
+        printf( "no hooks are running\n" );
+    }
+    return result;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file progress.h
+ *
+ * A lightweight progress channel for long-running hooks. A hook configured with
+ * 'progress' (or a heartbeat timeout) inherits the write end of a pipe, whose
+ * descriptor number is in CUCKOO_PROGRESS_FD, and may write lines to it:
+ *
+ *     progress=NN      percent complete (0-100, fractions allowed)
+ *     status=<text>    a short description of what it's doing
+ *     heartbeat        just 'still alive'
+ *
+ * Every line counts as a heartbeat. While a hook runs, cuckoo keeps a small status
+ * file describing it, which 'cuckoo --status' and 'cuckoo --metrics' report.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_PROGRESS_H
+#define CUCKOO_PROGRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define kProgressFdEnvVar   "CUCKOO_PROGRESS_FD"
+#define kStatusDir          "/dev/shm/cuckoo.status"
+#define kProgressMessageLen 96
+
+typedef struct {
+    int       readFd;       /* -1 once the hook closes its end */
+    int       writeFd;      /* the hook's end; closed in the parent once it's launched */
+    char *    statusPath;
+    pid_t     pid;
+    double    progress;     /* percent, or negative if never reported */
+    uint64_t  started;      /* CLOCK_MONOTONIC, in nanoseconds */
+    uint64_t  heartbeat;    /* CLOCK_MONOTONIC of the last line received */
+    uint64_t  written;      /* CLOCK_MONOTONIC of the last status file update */
+    const char * target;
+    const char * hook;
+    char      message[ kProgressMessageLen ];
+    char      buffer[ 256 ];
+    size_t    used;
+} tProgress;
+
+/* the status file, as read back by --status and --metrics */
+typedef struct {
+    pid_t     pid;
+    pid_t     hookPid;
+    char      target[ 64 ];
+    char      hook[ 128 ];
+    double    progress;
+    double    elapsed;      /* seconds */
+    double    heartbeatAge; /* seconds since the last line from the hook */
+    char      message[ kProgressMessageLen ];
+} tHookStatus;
+
+bool progressOpen(    tProgress * progress, const char * target, const char * hook );
+void progressStarted( tProgress * progress, pid_t pid );
+void progressRead(    tProgress * progress );
+void progressClose(   tProgress * progress );
+
+int  readHookStatus( bool (* callback)( const tHookStatus * status, void * context ), void * context );
+int  showStatus( int argc, char * argv[] );
+
+#endif /* CUCKOO_PROGRESS_H */
@@ -0,0 +1,683 @@
+/**
+ * @file queue.c
+ *
+ * Queued mode: limits how many hook chains run at once across every target.
+ *
+ * Free slots are granted to waiting invocations in this order:
+ *   1. by priority class, after aging - every 'queue.aging' seconds spent waiting
+ *      promotes an invocation by one class, so a low priority one can't starve.
+ *   2. by start-time fair queueing across targets - each grant advances the
+ *      target's finish tag by 1/weight, and the target with the lowest start
+ *      tag goes next, so a burst of one target can't starve the others.
+ *   3. first-come, first-served within a target.
+ *
+ * Slots are granted by a leader - a detached process forked by whichever waiting
+ * invocation first finds there isn't one. Everyone else just sleeps on the futex
+ * in their own queue entry until the leader grants them a slot. If a leader can't
+ * be started, waiting invocations fall back to granting slots themselves.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "queue.h"
+#include "fdpolicy.h"
+#include "adaptive.h"
+
+#define kVirtualUnit    1000000     /* virtual time consumed by one grant at weight 1 */
+
+static const char * priorityNames[ kPriorityCount ] = { "high", "normal", "low" };
+
+static int           queueFd = -1;
+static tQueueState * queueState;
+static int           queueSlot = -1;
+
+/**
+ * @brief
+ * @param priority
+ * @return
+ */
+const char * priorityName( tPriority priority )
+{
+    return ( priority < kPriorityCount ) ? priorityNames[ priority ] : "unknown";
+}
+
+/**
+ * @brief
+ * @param name
+ * @param defaultValue
+ * @return
+ */
+static tPriority parsePriority( const char * name, tPriority defaultValue )
+{
+    for ( tPriority priority = kPriorityHigh; priority < kPriorityCount; ++priority )
+    {
+        if ( strcasecmp( name, priorityNames[ priority ] ) == 0 )
+        {
+            return priority;
+        }
+    }
+    syslog( LOG_WARNING, "unknown priority class \'%s\'", name );
+    return defaultValue;
+}
+
+/**
+ * @brief determine the priority class of this invocation.
+ *
+ * In order of precedence: the CUCKOO_PRIORITY environment variable, the first of the
+ * 'priority.high', 'priority.normal' or 'priority.low' glob patterns that matches
+ * the invocation's arguments (joined by spaces), then the target's 'priority'.
+ *
+ * @param target
+ * @param argv
+ * @return
+ */
+tPriority getPriority( const char * target, char * argv[] )
+{
+    tPriority result = parsePriority( getScopedConfigString( "target", target, "priority", "normal" ),
+                                      kPriorityNormal );
+
+    const char * fromEnv = getenv( kQueuePriorityEnvVar );
+    if ( fromEnv != NULL && *fromEnv != '\0' )
+    {
+        return parsePriority( fromEnv, result );
+    }
+
+    size_t length = 1;
+    for ( int i = 1; argv[i] != NULL; ++i )
+    {
+        length += strlen( argv[i] ) + 1;
+    }
+
+    char * args = calloc( 1, length );
+    if ( args != NULL )
+    {
+        for ( int i = 1; argv[i] != NULL; ++i )
+        {
+            if ( i > 1 )
+            {
+                strcat( args, " " );
+            }
+            strcat( args, argv[i] );
+        }
+
+        for ( tPriority priority = kPriorityHigh; priority < kPriorityCount; ++priority )
+        {
+            char key[32];
+            snprintf( key, sizeof( key ), "priority.%s", priorityNames[ priority ] );
+            const char * pattern = getScopedConfigString( "target", target, key, NULL );
+            if ( pattern != NULL && fnmatch( pattern, args, 0 ) == 0 )
+            {
+                result = priority;
+                break;
+            }
+        }
+        free( args );
+    }
+
+    return result;
+}
+
+/**
+ * @brief open a file every user that runs a hooked target shares, creating it if necessary.
+ *        One we create is made read/write for all, whatever our umask, or the next user to
+ *        come along couldn't use it. One that already exists is left as its owner made it.
+ * @param path
+ * @return the descriptor, or -1 with errno set
+ */
+static int openShared( const char * path )
+{
+    int fd = open( path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666 );
+    if ( fd >= 0 )
+    {
+        fchmod( fd, 0666 );
+    }
+    else if ( errno == EEXIST )
+    {
+        fd = open( path, O_RDWR | O_CLOEXEC );
+    }
+    return fd;
+}
+
+/**
+ * @brief map the shared queue state into this process, creating it if necessary
+ * @param readOnly if true, don't create or initialize it
+ * @return NULL if there is no usable queue state
+ */
+tQueueState * queueAttach( bool readOnly )
+{
+    if ( queueState != NULL )
+    {
+        return queueState;
+    }
+
+    const char * path = getConfigString( "queue.file", kQueuePath );
+
+    queueFd = readOnly ? open( path, O_RDONLY | O_CLOEXEC ) : openShared( path );
+    if ( queueFd < 0 )
+    {
+        if ( !readOnly || errno != ENOENT )
+        {
+            syslog( LOG_WARNING, "unable to open queue \'%s\' (%m)", path );
+        }
+        return NULL;
+    }
+
+    flock( queueFd, readOnly ? LOCK_SH : LOCK_EX );
+
+    struct stat queueStat;
+    if ( fstat( queueFd, &queueStat ) == 0 )
+    {
+        if ( queueStat.st_size < (off_t)sizeof( tQueueState ) && !readOnly )
+        {
+            if ( ftruncate( queueFd, sizeof( tQueueState ) ) == 0 )
+            {
+                queueStat.st_size = sizeof( tQueueState );
+            }
+        }
+
+        if ( queueStat.st_size >= (off_t)sizeof( tQueueState ) )
+        {
+            void * mapped = mmap( NULL, sizeof( tQueueState ),
+                                  readOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, queueFd, 0 );
+            if ( mapped != MAP_FAILED )
+            {
+                queueState = mapped;
+            }
+        }
+    }
+
+    if ( queueState != NULL
+      && ( queueState->magic != kQueueMagic || queueState->version != kQueueVersion ) )
+    {
+        if ( readOnly )
+        {
+            munmap( queueState, sizeof( tQueueState ) );
+            queueState = NULL;
+        }
+        else
+        {
+            /* new, or left behind by an incompatible version */
+            memset( queueState, 0, sizeof( tQueueState ) );
+            queueState->magic   = kQueueMagic;
+            queueState->version = kQueueVersion;
+        }
+    }
+
+    flock( queueFd, LOCK_UN );
+
+    if ( queueState == NULL )
+    {
+        close( queueFd );
+        queueFd = -1;
+    }
+    return queueState;
+}
+
+/**
+ * @brief
+ * @param state
+ */
+void queueDetach( tQueueState * state )
+{
+    if ( state != NULL && state == queueState )
+    {
+        munmap( queueState, sizeof( tQueueState ) );
+        queueState = NULL;
+        close( queueFd );
+        queueFd = -1;
+    }
+}
+
+/**
+ * @brief release the entries of invocations that exited (or were killed) without leaving the
+ *        queue, and any that don't name a valid target (the state is shared, so can't be trusted)
+ * @param state
+ */
+static void reapQueue( tQueueState * state )
+{
+    for ( int i = 0; i < kQueueEntries; ++i )
+    {
+        tQueueEntry * entry = &state->entries[i];
+        if ( entry->state == kEntryFree )
+        {
+            continue;
+        }
+        if ( entry->target >= kQueueTargets )
+        {
+            syslog( LOG_WARNING, "reclaimed queue entry of process %d, with invalid target %u",
+                    entry->pid, entry->target );
+            entry->state = kEntryFree;
+        }
+        else if ( kill( entry->pid, 0 ) != 0 && errno == ESRCH )
+        {
+            syslog( LOG_NOTICE, "reclaimed queue entry of vanished process %d", entry->pid );
+            entry->state = kEntryFree;
+        }
+    }
+}
+
+/**
+ * @brief find the target in the shared target table, adding it (or recycling an idle one) if necessary
+ * @return index into state->targets, or -1 if the table is full
+ */
+static int findTarget( tQueueState * state, const char * name, uint32_t weight )
+{
+    int idle = -1;
+
+    for ( int i = 0; i < kQueueTargets; ++i )
+    {
+        tQueueTarget * target = &state->targets[i];
+        if ( strncmp( target->name, name, kQueueTargetLen - 1 ) == 0 )
+        {
+            target->weight = weight;
+            return i;
+        }
+
+        if ( idle < 0 )
+        {
+            bool inUse = false;
+            for ( int j = 0; j < kQueueEntries && !inUse; ++j )
+            {
+                inUse = ( state->entries[j].state != kEntryFree && state->entries[j].target == (uint32_t)i );
+            }
+            if ( !inUse )
+            {
+                idle = i;
+            }
+        }
+    }
+
+    if ( idle >= 0 )
+    {
+        tQueueTarget * target = &state->targets[ idle ];
+        memset( target, 0, sizeof( tQueueTarget ) );
+        strncpy( target->name, name, kQueueTargetLen - 1 );
+        target->weight    = weight;
+        target->finishTag = state->virtualTime;
+    }
+    return idle;
+}
+
+/**
+ * @brief choose the waiting entry that should be granted the next free slot
+ * @param state
+ * @param now CLOCK_MONOTONIC, in nanoseconds
+ * @param aging nanoseconds of waiting per priority class promotion
+ * @return index into state->entries, or -1 if nobody is waiting
+ */
+static int pickNext( const tQueueState * state, uint64_t now, uint64_t aging )
+{
+    int      best         = -1;
+    uint64_t bestPriority = 0;
+    uint64_t bestStartTag = 0;
+
+    for ( int i = 0; i < kQueueEntries; ++i )
+    {
+        const tQueueEntry * entry = &state->entries[i];
+        if ( entry->state != kEntryWaiting || entry->target >= kQueueTargets )
+        {
+            /* an out-of-range target is as good as free - reapQueue() will release it */
+            continue;
+        }
+
+        uint64_t promotions = ( aging > 0 && now > entry->enqueued ) ? ( now - entry->enqueued ) / aging : 0;
+        uint64_t priority   = ( entry->priority > promotions ) ? entry->priority - promotions : kPriorityHigh;
+
+        uint64_t startTag = state->targets[ entry->target ].finishTag;
+        if ( startTag < state->virtualTime )
+        {
+            /* a target that's been idle doesn't get to bank credit */
+            startTag = state->virtualTime;
+        }
+
+        if ( best < 0
+          || priority < bestPriority
+          || ( priority == bestPriority && startTag < bestStartTag )
+          || ( priority == bestPriority && startTag == bestStartTag
+               && entry->enqueued < state->entries[ best ].enqueued ) )
+        {
+            best         = i;
+            bestPriority = priority;
+            bestStartTag = startTag;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief sleep until '*word' is no longer 'expected', or 'seconds' pass
+ */
+static void futexWait( uint32_t * word, uint32_t expected, long seconds )
+{
+    struct timespec timeout = { seconds, 0 };
+    syscall( SYS_futex, word, FUTEX_WAIT, expected, &timeout, NULL, 0 );
+}
+
+/**
+ * @brief bump '*word' and wake everyone sleeping on it
+ */
+static void futexRing( uint32_t * word )
+{
+    __atomic_add_fetch( word, 1, __ATOMIC_SEQ_CST );
+    syscall( SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+}
+
+/**
+ * @brief hand out as many free slots as the limit allows. Called with the queue locked.
+ * @param state
+ * @param limit the configured limit - the leader's adaptive limit takes precedence
+ * @param aging nanoseconds of waiting per priority class promotion
+ * @param running if not NULL, set to how many chains are now running
+ * @return how many invocations are still waiting
+ */
+static int grantSlots( tQueueState * state, long limit, uint64_t aging, long * running )
+{
+    reapQueue( state );
+    if ( state->limit > 0 )
+    {
+        limit = state->limit;
+    }
+
+    long busy    = 0;
+    int  waiting = 0;
+    for ( int i = 0; i < kQueueEntries; ++i )
+    {
+        busy    += ( state->entries[i].state == kEntryRunning );
+        waiting += ( state->entries[i].state == kEntryWaiting );
+    }
+
+    uint64_t now = nowNanoseconds( CLOCK_MONOTONIC );
+    while ( busy < limit && waiting > 0 )
+    {
+        int next = pickNext( state, now, aging );
+        if ( next < 0 )
+        {
+            break;
+        }
+
+        tQueueEntry  * entry = &state->entries[ next ];
+        tQueueTarget * tgt   = &state->targets[ entry->target ];
+
+        uint64_t startTag = ( tgt->finishTag > state->virtualTime ) ? tgt->finishTag : state->virtualTime;
+        state->virtualTime = startTag;
+        tgt->finishTag     = startTag + kVirtualUnit / ( tgt->weight > 0 ? tgt->weight : 1 );
+
+        entry->granted = now;
+        __atomic_store_n( &entry->state, kEntryRunning, __ATOMIC_RELEASE );
+        futexRing( &entry->wake );
+
+        ++busy;
+        --waiting;
+    }
+    if ( running != NULL )
+    {
+        *running = busy;
+    }
+    return waiting;
+}
+
+/**
+ * @brief the leader's main loop - grant slots whenever something changes, until nothing
+ *        has waited for kQueueLeaderLinger seconds
+ * @param state
+ * @param leaderFd holds the leader lock
+ * @param limit
+ * @param aging
+ */
+static void runLeader( tQueueState * state, int leaderFd, long limit, uint64_t aging )
+{
+    uint64_t  idleSince = nowNanoseconds( CLOCK_MONOTONIC );
+    tAdaptive adaptive;
+
+    flock( queueFd, LOCK_EX );
+    state->leader = getpid();
+    adaptiveInit( &adaptive, state, limit );
+    flock( queueFd, LOCK_UN );
+    syslog( LOG_DEBUG, "leading the queue" );
+
+    for (;;)
+    {
+        flock( queueFd, LOCK_EX );
+        uint32_t doorbell = __atomic_load_n( &state->doorbell, __ATOMIC_ACQUIRE );
+        long     running;
+        int      waiting  = grantSlots( state, limit, aging, &running );
+        adaptiveUpdate( &adaptive, state, running, waiting );
+
+        uint64_t now = nowNanoseconds( CLOCK_MONOTONIC );
+        if ( waiting > 0 )
+        {
+            idleSince = now;
+        }
+        else if ( now - idleSince >= kQueueLeaderLinger * 1000000000ULL )
+        {
+            /* give up the leadership while the queue is still locked, so a newcomer
+             * either shows up above, or finds the leader lock free */
+            state->leader = 0;
+            flock( leaderFd, LOCK_UN );
+            flock( queueFd, LOCK_UN );
+            break;
+        }
+        flock( queueFd, LOCK_UN );
+
+        /* woken early when an invocation joins or leaves the queue */
+        futexWait( &state->doorbell, doorbell, kQueueLeaderCheck );
+    }
+    syslog( LOG_DEBUG, "queue idle, no longer leading" );
+}
+
+/**
+ * @brief make sure there's a leader, forking one if there isn't. Called with the queue locked.
+ * @param state
+ * @param limit
+ * @param aging
+ * @return false if there's no leader and one couldn't be started
+ */
+static bool ensureLeader( tQueueState * state, long limit, uint64_t aging )
+{
+    char * path = NULL;
+    if ( asprintf( &path, "%s%s", getConfigString( "queue.file", kQueuePath ), kQueueLeaderSuffix ) < 0 )
+    {
+        return false;
+    }
+
+    int leaderFd = openShared( path );
+    if ( leaderFd < 0 )
+    {
+        syslog( LOG_WARNING, "unable to open \'%s\' (%m)", path );
+        free( path );
+        return false;
+    }
+    if ( flock( leaderFd, LOCK_EX | LOCK_NB ) != 0 )
+    {
+        /* somebody already is */
+        bool result = ( errno == EWOULDBLOCK );
+        close( leaderFd );
+        free( path );
+        return result;
+    }
+
+    pid_t pid = daemonize( &leaderFd, 1 );
+    if ( pid == 0 )
+    {
+        /* a lock of its own on the queue - ours is shared with whoever forked it, and closed */
+        queueFd = open( getConfigString( "queue.file", kQueuePath ), O_RDWR | O_CLOEXEC );
+        if ( queueFd >= 0 )
+        {
+            runLeader( state, leaderFd, limit, aging );
+        }
+        _exit( 0 );
+    }
+
+    /* the leader's copy of the descriptor holds the lock from here on */
+    close( leaderFd );
+    if ( pid < 0 )
+    {
+        syslog( LOG_WARNING, "unable to start a queue leader (%m)" );
+        free( path );
+        return false;
+    }
+    waitpid( pid, NULL, 0 );
+    free( path );
+    return true;
+}
+
+/**
+ * @brief wait until this invocation may run its hook chain. A no-op unless 'queue.limit' is set.
+ * @param target
+ * @param priority
+ * @return how long we waited, in nanoseconds
+ */
+uint64_t queueEnter( const char * target, tPriority priority )
+{
+    long limit = getConfigNumber( "queue.limit", 0 );
+    if ( limit <= 0 )
+    {
+        return 0;
+    }
+
+    uint64_t aging    = parseDuration( getConfigString( "queue.aging", NULL ), kQueueAging ) * 1000000000ULL;
+    uint32_t weight   = getScopedConfigNumber( "target", target, "queue.weight", 1 );
+    uint64_t enqueued = nowNanoseconds( CLOCK_MONOTONIC );
+
+    tQueueState * state = queueAttach( false );
+    if ( state == NULL )
+    {
+        /* better to run unqueued than not at all - but not without saying so */
+        syslog( LOG_WARNING, "the queue is unavailable, so '%s' is running unqueued", target );
+        return 0;
+    }
+
+    bool leader = false;
+
+    flock( queueFd, LOCK_EX );
+    reapQueue( state );
+
+    int targetIndex = findTarget( state, target, weight > 0 ? weight : 1 );
+    for ( int i = 0; i < kQueueEntries && targetIndex >= 0; ++i )
+    {
+        tQueueEntry * entry = &state->entries[i];
+        if ( entry->state == kEntryFree )
+        {
+            memset( entry, 0, sizeof( tQueueEntry ) );
+            entry->pid      = getpid();
+            entry->state    = kEntryWaiting;
+            entry->priority = priority;
+            entry->target   = targetIndex;
+            entry->enqueued = enqueued;
+            queueSlot = i;
+            break;
+        }
+    }
+    if ( queueSlot >= 0 )
+    {
+        futexRing( &state->doorbell );
+        leader = ensureLeader( state, limit, aging );
+    }
+    flock( queueFd, LOCK_UN );
+
+    if ( queueSlot < 0 )
+    {
+        syslog( LOG_WARNING, "queue is full, running \'%s\' unqueued", target );
+        queueDetach( state );
+        return 0;
+    }
+
+    tQueueEntry * entry = &state->entries[ queueSlot ];
+    struct timespec backoff = { 0, 10 * 1000000 };
+    for (;;)
+    {
+        uint32_t wake = __atomic_load_n( &entry->wake, __ATOMIC_ACQUIRE );
+        if ( __atomic_load_n( &entry->state, __ATOMIC_ACQUIRE ) == kEntryRunning )
+        {
+            break;
+        }
+
+        if ( leader )
+        {
+            futexWait( &entry->wake, wake, kQueueLeaderCheck );
+        }
+        else
+        {
+            nanosleep( &backoff, NULL );
+            if ( backoff.tv_nsec < 250 * 1000000 )
+            {
+                backoff.tv_nsec *= 2;
+            }
+        }
+
+        if ( __atomic_load_n( &entry->state, __ATOMIC_ACQUIRE ) == kEntryRunning )
+        {
+            break;
+        }
+
+        /* the leader may have died, or left just as we arrived */
+        flock( queueFd, LOCK_EX );
+        leader = ensureLeader( state, limit, aging );
+        if ( !leader )
+        {
+            grantSlots( state, limit, aging, NULL );
+        }
+        flock( queueFd, LOCK_UN );
+    }
+
+    uint64_t waited = nowNanoseconds( CLOCK_MONOTONIC ) - enqueued;
+    if ( waited > 1000000000 )
+    {
+        syslog( LOG_INFO, "\'%s\' (%s priority) waited %.1fs for a slot",
+                target, priorityName( priority ), waited / 1e9 );
+    }
+    return waited;
+}
+
+/**
+ * @brief give up our slot, if we have one
+ */
+void queueLeave( void )
+{
+    if ( queueSlot >= 0 && queueState != NULL )
+    {
+        flock( queueFd, LOCK_EX );
+        tQueueEntry * entry = &queueState->entries[ queueSlot ];
+        if ( entry->pid == getpid() )
+        {
+            if ( entry->state == kEntryRunning )
+            {
+                queueState->completed += 1;
+                queueState->busyTime  += nowNanoseconds( CLOCK_MONOTONIC ) - entry->granted;
+            }
+            entry->state = kEntryFree;
+            /* a slot's free, so let the leader know */
+            futexRing( &queueState->doorbell );
+        }
+        flock( queueFd, LOCK_UN );
+
+        queueSlot = -1;
+        queueDetach( queueState );
+    }
+}
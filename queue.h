@@ -0,0 +1,93 @@
+/**
+ * @file queue.h
+ *
+ * Queued mode: limits how many hook chains run at once across every target,
+ * granting the free slots by priority class, then by weighted fair queueing
+ * across targets, then first-come first-served. Waiting invocations age into
+ * higher priority classes so nothing starves.
+ *
+ * The queue state lives in a small file shared (mmap'd) by every concurrent
+ * invocation of cuckoo, serialized with flock(). There's no daemon: the first
+ * invocation that has to wait forks a detached leader, which holds a lock on
+ * '<queue.file>.leader', grants slots as they free up, and exits once nothing
+ * has waited for a while. Waiting invocations sleep on a futex in their queue
+ * entry, and check now and then that the leader is still there, electing a new
+ * one if it isn't.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_QUEUE_H
+#define CUCKOO_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define kQueuePath          "/dev/shm/cuckoo.queue"
+#define kQueueMagic         0x6b637571      /* 'kcuq' */
+#define kQueueVersion       4
+#define kQueueEntries       64
+#define kQueueTargets       32
+#define kQueueTargetLen     32
+#define kQueueAging         30              /* seconds waited per priority class promotion */
+#define kQueuePriorityEnvVar "CUCKOO_PRIORITY"
+#define kQueueLeaderSuffix  ".leader"
+#define kQueueLeaderLinger  10              /* seconds the leader stays around with nothing waiting */
+#define kQueueLeaderCheck   1               /* seconds between a waiter's checks on the leader */
+
+typedef enum {
+    kPriorityHigh = 0,
+    kPriorityNormal,
+    kPriorityLow,
+    kPriorityCount
+} tPriority;
+
+typedef enum {
+    kEntryFree = 0,
+    kEntryWaiting,
+    kEntryRunning
+} tEntryState;
+
+typedef struct {
+    int32_t   pid;
+    uint16_t  state;        /* tEntryState */
+    uint16_t  priority;     /* tPriority */
+    uint32_t  target;       /* index into tQueueState.targets */
+    uint32_t  wake;         /* futex - bumped when the entry is granted a slot */
+    uint64_t  enqueued;     /* CLOCK_MONOTONIC, in nanoseconds */
+    uint64_t  granted;
+} tQueueEntry;
+
+typedef struct {
+    char      name[ kQueueTargetLen ];
+    uint32_t  weight;
+    uint32_t  reserved;
+    uint64_t  finishTag;    /* virtual time at which this target's last grant 'finished' */
+} tQueueTarget;
+
+typedef struct {
+    uint32_t      magic;
+    uint32_t      version;
+    uint64_t      virtualTime;
+    uint32_t      doorbell;     /* futex - bumped whenever the leader may have something to do */
+    int32_t       leader;       /* pid of the leader, or 0 if there isn't one */
+    uint32_t      limit;        /* set by the leader when the limit is adaptive, otherwise 0 */
+    uint32_t      reserved;
+    uint64_t      completed;    /* hook chains that have left the queue after running */
+    uint64_t      busyTime;     /* total nanoseconds those chains spent running */
+    double        baseline;     /* the adaptive limit's baseline latency and last throughput, */
+    double        throughput;   /* kept here so the next leader carries on with them - see adaptive.h */
+    tQueueTarget  targets[ kQueueTargets ];
+    tQueueEntry   entries[ kQueueEntries ];
+} tQueueState;
+
+tPriority    getPriority( const char * target, char * argv[] );
+const char * priorityName( tPriority priority );
+
+uint64_t     queueEnter( const char * target, tPriority priority );
+void         queueLeave( void );
+
+tQueueState * queueAttach( bool readOnly );
+void          queueDetach( tQueueState * state );
+
+#endif /* CUCKOO_QUEUE_H */
@@ -0,0 +1,63 @@
+/**
+ * @file report.c
+ *
+ * diagnostic output shared by all of cuckoo's modules
+ *
+ * Created by Paul Chambers on 5/3/21.
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include "report.h"
+
+void DebugF_( const char * function, const int line, const char * format, ... )
+{
+	va_list args;
+
+	va_start( args, format );
+
+	vfprintf( stderr, format, args );
+	fprintf(  stderr, " (%s() at line %d)\n", function, line );
+
+	va_end( args );
+}
+
+int ReportError_( const char * function, const int line, const char * format, ... )
+{
+    va_list args;
+
+    int savedErrno = errno;
+
+    va_start( args, format );
+
+    fprintf(  stderr, "err: " );
+    vfprintf( stderr, format, args );
+    fprintf(  stderr, " (%s() at line %d)\n", function, line );
+
+    va_end( args );
+
+    return savedErrno;
+}
+
+int ReportErrno_( const char * function, const int line, const char * format, ... )
+{
+	va_list args;
+
+	int savedErrno = errno;
+
+	va_start( args, format );
+
+	fprintf( stderr, "err: " );
+	vfprintf( stderr, format, args );
+	fprintf( stderr, " (%d: %s) in %s() at line %d\n", savedErrno, strerror( savedErrno ), function, line );
+
+	va_end( args );
+
+	return savedErrno;
+}
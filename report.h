@@ -0,0 +1,24 @@
+/**
+ * @file report.h
+ *
+ * diagnostic output shared by all of cuckoo's modules
+ *
+ * Created by Paul Chambers on 5/3/21.
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_REPORT_H
+#define CUCKOO_REPORT_H
+
+#define debugf( ... )       DebugF_(      __func__, __LINE__, __VA_ARGS__ )
+#define reportError( ... )  ReportError_( __func__, __LINE__, __VA_ARGS__ )
+#define reportErrno( ... )  ReportErrno_( __func__, __LINE__, __VA_ARGS__ )
+
+void DebugF_(      const char * function, int line, const char * format, ... )
+                   __attribute__ ((format (printf, 3, 4)));
+int  ReportError_( const char * function, int line, const char * format, ... )
+                   __attribute__ ((format (printf, 3, 4)));
+int  ReportErrno_( const char * function, int line, const char * format, ... )
+                   __attribute__ ((format (printf, 3, 4)));
+
+#endif /* CUCKOO_REPORT_H */
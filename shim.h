@@ -0,0 +1,54 @@
+/**
+ * @file shim.h
+ *
+ * The plan file shared by the full runner and cuckoo-shim. The symlink points at
+ * the shim, which is statically linked so it starts quickly. When the runner finds
+ * a target's chain needs none of its features (queueing, timeouts, canaries, fd
+ * redirection, progress or data channels), it writes the chain out as a plan
+ * beside the target, as '.<target>.plan'. The shim runs a plan itself, appending
+ * to the history as the runner would, and hands everything else off to the runner.
+ *
+ * A plan carries stamps of the configuration file, both hook directories and
+ * every hook, so the shim can tell when it's out of date without scanning anything.
+ * A stale plan is handed off too, and the runner rewrites (or removes) it.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_SHIM_H
+#define CUCKOO_SHIM_H
+
+#include <stdint.h>
+
+#define kShimPlanMagic      0x6e616c50      /* 'Plan' */
+#define kShimPlanVersion    2
+#define kShimPlanSuffix     ".plan"
+#define kShimPlanMaxSize    65536
+#define kShimName           "cuckoo-shim"
+#define kRunnerName         "cuckoo"
+
+/* tShimPlan.flags, per hook */
+#define kShimCloseInherited (1 << 0)        /* close everything but stdio before exec'ing it */
+
+/* identifies a version of a file or directory. A missing one has ino 0. */
+typedef struct {
+    uint64_t  dev;
+    uint64_t  ino;
+    int64_t   sec;          /* st_ctim, which changes with its contents and its permissions */
+    int64_t   nsec;
+} tShimStamp;
+
+/* followed by 'count' tShimStamps (one per hook), 'count' flag bytes, then the
+ * NUL-terminated paths of the config file, the two directories, the history file
+ * (empty if it's off) and the hooks, in order */
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    size;       /* of the whole file */
+    uint32_t    count;      /* hooks */
+    tShimStamp  config;
+    tShimStamp  dirs[2];    /* the scripts and common directories */
+    int64_t     historyMaxSize;     /* rotate the history beyond this, unless <= 0 */
+} tShimPlan;
+
+#endif /* CUCKOO_SHIM_H */
@@ -0,0 +1,165 @@
+#!/bin/sh
+#
+# dvr-update-sim.sh - reproduces what happens when Channels DVR updates itself
+# underneath a hooked comskip.
+#
+# A stand-in 'DVR' runs several workers that repeatedly exec latest/comskip,
+# while an 'updater' unpacks a new version directory, swaps the 'latest' symlink
+# over to it, then re-hooks the new comskip by running 'cuckoo' on it, as the
+# cron job in the README does. Every invocation is expected to run the hook in
+# the common directory; afterwards the harness reports how many missed it, how
+# many failed outright, and how long each re-hook took.
+#
+# An invocation that overlaps an update (from the swap until the re-hook is done)
+# may run the new, not yet hooked, comskip - that's inherent, and it's reported
+# but not held against the run. One that doesn't overlap an update has no excuse
+# for missing its hook, so by default none may.
+#
+# usage: dvr-update-sim.sh <path to cuckoo> [<seconds>]
+#
+# Tunables (environment):
+#   SIM_WORKERS         concurrent DVR workers (default 4)
+#   SIM_UPDATES         number of updates during the run (default 5)
+#   SIM_REHOOK_DELAY    seconds between the swap and the re-hook (default 0)
+#   SIM_MAX_FAILURES    failed invocations tolerated (default 0)
+#   SIM_MAX_MISSED      invocations outside an update that missed their hook tolerated (default 0)
+#   SIM_MAX_INSTALL_MS  slowest re-hook tolerated, in milliseconds (default 1000)
+#
+# MIT Licensed
+
+set -u
+
+cuckoo=$(realpath "${1:?usage: $0 <path to cuckoo> [<seconds>]}")
+duration=${2:-10}
+workers=${SIM_WORKERS:-4}
+updates=${SIM_UPDATES:-5}
+rehookDelay=${SIM_REHOOK_DELAY:-0}
+maxFailures=${SIM_MAX_FAILURES:-0}
+maxMissed=${SIM_MAX_MISSED:-0}
+maxInstallMs=${SIM_MAX_INSTALL_MS:-1000}
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/cuckoo-sim.XXXXXX")
+trap 'rm -rf "$work"' EXIT INT TERM
+
+# keep everything cuckoo touches inside the scratch directory
+cat > "$work/cuckoo.conf" <<CONF
+commonDir    = $work/etc
+history.file = $work/history
+status.dir   = $work/status
+queue.file   = $work/queue
+CONF
+export CUCKOO_CONFIG="$work/cuckoo.conf"
+
+mkdir -p "$work/dvr" "$work/etc/comskip" "$work/log"
+
+fakeComskip=$(PATH=/usr/bin:/bin which true)
+
+# the hook every invocation should run, whichever version of comskip is current
+cat > "$work/etc/comskip/70-mark" <<HOOK
+#!/bin/sh
+echo "\$1" >> "$work/log/hooked.\$1"
+HOOK
+chmod +x "$work/etc/comskip/70-mark"
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# unpack version '$1' of the DVR, with its own (fake) comskip. It's a binary like the real one:
+# a script would be opened by path by its interpreter, after exec, and could find itself replaced.
+unpack() {
+    mkdir -p "$work/dvr/$1"
+    cp "$fakeComskip" "$work/dvr/$1/comskip"
+}
+
+# point 'latest' at version '$1' atomically, as an updater would
+swap() {
+    ln -sfn "$1" "$work/dvr/latest.new"
+    mv -T "$work/dvr/latest.new" "$work/dvr/latest"
+}
+
+unpack v0
+swap v0
+"$cuckoo" "$work/dvr/latest/comskip" > /dev/null || { echo "initial install failed"; exit 1; }
+
+# the DVR: each worker invokes comskip with a unique argument, so the hook's log shows which ran.
+# Each is logged as '<started> <finished> <id>', to tell which overlapped an update.
+worker() {
+    n=0
+    end=$(( $(now_ms) + duration * 1000 ))
+    while [ "$(now_ms)" -lt "$end" ]; do
+        n=$(( n + 1 ))
+        id="$1-$n"
+        started=$(now_ms)
+        if "$work/dvr/latest/comskip" "$id" > /dev/null 2>&1; then
+            echo "$started $(now_ms) $id" >> "$work/log/ok.$1"
+        else
+            echo "$started $(now_ms) $id" >> "$work/log/failed.$1"
+        fi
+    done
+}
+
+i=0
+while [ "$i" -lt "$workers" ]; do
+    worker "$i" &
+    i=$(( i + 1 ))
+done
+
+# the updater
+u=1
+while [ "$u" -le "$updates" ]; do
+    sleep "$(awk "BEGIN { print $duration / ( $updates + 1 ) }")"
+    unpack "v$u"
+    swapped=$(now_ms)
+    swap "v$u"
+    sleep "$rehookDelay"
+    start=$(now_ms)
+    "$cuckoo" "$work/dvr/latest/comskip" > /dev/null 2>&1 || echo "re-hook of v$u failed"
+    done=$(now_ms)
+    echo $(( done - start )) >> "$work/log/install"
+    echo "$swapped $done" >> "$work/log/updates"
+    u=$(( u + 1 ))
+done
+wait
+
+count() {
+    cat "$work/log/"$1.* 2>/dev/null | wc -l
+}
+
+invoked=$(( $(count ok) + $(count failed) ))
+failed=$(count failed)
+hooked=$(count hooked)
+missed=$(( $(count ok) - hooked ))
+slowest=$(sort -n "$work/log/install" | tail -1)
+
+# of those that missed their hook, the ones that didn't overlap an update
+unexcused=$(cat "$work/log/hooked."* 2>/dev/null \
+    | awk -v updates="$work/log/updates" '
+        BEGIN { while ( ( getline line < updates ) > 0 ) { split( line, u, " " ); from[++n] = u[1]; to[n] = u[2] } }
+        FILENAME == "-" { hooked[ $1 ] = 1; next }
+        !( $3 in hooked ) {
+            overlaps = 0
+            for ( i = 1; i <= n; ++i ) { if ( $1 <= to[i] && $2 >= from[i] ) { overlaps = 1 } }
+            missed += !overlaps
+        }
+        END { print missed + 0 }' - "$work/log/"ok.*)
+
+echo "invocations:      $invoked"
+echo "failed:           $failed"
+echo "missed the hook:  $missed ($unexcused outside an update)"
+echo "re-hook latency:  $(sort -n "$work/log/install" | tr '\n' ' ')ms (slowest $slowest ms)"
+
+result=0
+if [ "$failed" -gt "$maxFailures" ]; then
+    echo "FAIL: more than $maxFailures failed invocations"
+    result=1
+fi
+if [ "$unexcused" -gt "$maxMissed" ]; then
+    echo "FAIL: more than $maxMissed invocations outside an update missed their hook"
+    result=1
+fi
+if [ "$slowest" -gt "$maxInstallMs" ]; then
+    echo "FAIL: a re-hook took longer than ${maxInstallMs}ms"
+    result=1
+fi
+exit $result
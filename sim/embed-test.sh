@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# embed-test.sh - checks libcuckoo.a works when embedded, as the README says.
+#
+# Runs a small chain through 'embed' (sim/embed.c, linked against the archive
+# and nothing else of cuckoo's), and checks each hook ran in order with the
+# arguments given, the one the 'before' callback skips didn't, the chain's exit
+# code is the first failure's, and the history recorded it. Then checks the
+# archive exports nothing but the cuckoo* API.
+#
+# usage: embed-test.sh <path to embed> <path to libcuckoo.a>
+#
+# MIT Licensed
+
+set -u
+
+embed=$(realpath "${1:?usage: $0 <path to embed> <path to libcuckoo.a>}")
+archive=$(realpath "${2:?usage: $0 <path to embed> <path to libcuckoo.a>}")
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/cuckoo-embed.XXXXXX")
+trap 'rm -rf "$work"' EXIT INT TERM
+
+failed=0
+fail() {
+    echo "FAIL: $*"
+    failed=1
+}
+
+# keep everything the library touches inside the scratch directory
+cat > "$work/cuckoo.conf" <<CONF
+commonDir    = $work/etc
+history.file = $work/history
+status.dir   = $work/status
+CONF
+export CUCKOO_CONFIG="$work/cuckoo.conf"
+
+# a target as 'cuckoo' would have hooked it, though it's never exec'd itself
+mkdir -p "$work/bin/.target.d" "$work/etc/target"
+printf '#!/bin/sh\n' > "$work/bin/target"
+chmod +x "$work/bin/target"
+
+# name, exit code
+mkhook() {
+    printf '#!/bin/sh\necho "%s $*" >> "%s"\nexit %d\n' "${1##*/}" "$work/log" "$2" > "$1"
+    chmod +x "$1"
+}
+mkhook "$work/etc/target/10-first" 0
+mkhook "$work/bin/.target.d/20-second" 0
+mkhook "$work/bin/.target.d/30-this-skip" 0
+mkhook "$work/bin/.target.d/50-target" 3
+mkhook "$work/etc/target/60-after" 4
+
+"$embed" "$work/bin/target" one two > "$work/out"
+result=$?
+
+[ $result -eq 3 ] || fail "the chain exited with $result, not 3"
+
+for run in 0 1; do
+    grep -q "^run $run: 5 hooks for 'target'$" "$work/out" || fail "run $run didn't plan the 5 hooks"
+done
+[ "$(grep -c '^30-this-skip skipped$' "$work/out")" -eq 2 ] || fail "the 'before' callback didn't skip 30-this-skip"
+[ "$(grep -c '^50-target ran 3$' "$work/out")" -eq 2 ]      || fail "the 'after' callback didn't see 50-target's exit code"
+
+expected="10-first one two
+20-second one two
+50-target one two
+60-after one two"
+[ "$(cat "$work/log")" = "$(printf '%s\n%s\n' "$expected" "$expected")" ] \
+    || fail "the hooks didn't run as expected:" "$(cat "$work/log")"
+
+# 8 hooks ran, at 160 bytes a record
+size=$(wc -c < "$work/history")
+[ "$size" -eq $(( 8 * 160 )) ] || fail "the history is $size bytes, not the 8 records expected"
+
+exported=$(nm -g --defined-only "$archive" | awk 'NF == 3 { print $3 }' | grep -v '^cuckoo')
+[ -z "$exported" ] || fail "libcuckoo.a exports more than the cuckoo* API:" $exported
+
+[ $failed -eq 0 ] && echo "libcuckoo.a embedded and ran the chain as expected"
+exit $failed
@@ -0,0 +1,89 @@
+/**
+ * @file embed.c
+ *
+ * A minimal program embedding libcuckoo.a, as a long-running program would, for
+ * embed-test.sh to run. It runs the chain hooked onto the target given, skipping
+ * any hook whose name ends in '-skip' (to exercise the 'before' callback), and
+ * prints a line for each hook, from the 'after' callback if it ran and from the
+ * results if it didn't. It runs the chain twice, the second time from the cached
+ * plan, and exits with the second run's result.
+ *
+ * usage: embed <path to the hooked target> [<arguments>...]
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcuckoo.h"
+
+static bool before( void * context, const tCuckooHook * hook )
+{
+    (void)context;
+
+    size_t len = strlen( hook->name );
+    return ( len < 5 || strcmp( &hook->name[ len - 5 ], "-skip" ) != 0 );
+}
+
+static void after( void * context, const tCuckooHook * hook, const tCuckooResult * result )
+{
+    (void)context;
+    printf( "%s ran %d\n", hook->name, result->result );
+    fflush( stdout );
+}
+
+int main( int argc, char * argv[], char * envp[] )
+{
+    if ( argc < 2 )
+    {
+        fprintf( stderr, "usage: %s <path to the hooked target> [<arguments>...]\n", argv[0] );
+        return 2;
+    }
+    if ( cuckooApiVersion() != kCuckooApiVersion )
+    {
+        fprintf( stderr, "libcuckoo is version %d, but the header is version %d\n",
+                 cuckooApiVersion(), kCuckooApiVersion );
+        return 2;
+    }
+
+    int result = 2;
+    for ( int run = 0; run < 2; ++run )
+    {
+        /* twice, so the second is served from the cached plan */
+        tCuckooPlan * plan = cuckooPlan( argv[1] );
+        if ( plan == NULL )
+        {
+            fprintf( stderr, "no plan for '%s'\n", argv[1] );
+            return 2;
+        }
+
+        tCuckooCallbacks callbacks = { before, after, NULL };
+        tCuckooResult *  results   = calloc( cuckooPlanSize( plan ), sizeof( tCuckooResult ) );
+        if ( results == NULL )
+        {
+            return 2;
+        }
+
+        printf( "run %d: %zu hooks for '%s'\n", run, cuckooPlanSize( plan ), cuckooPlanTarget( plan ) );
+        /* the hooks share our stdout */
+        fflush( stdout );
+        result = cuckooRun( plan, &argv[1], envp, &callbacks, results );
+        for ( size_t i = 0; i < cuckooPlanSize( plan ); ++i )
+        {
+            if ( !results[i].ran )
+            {
+                printf( "%s skipped\n", cuckooPlanHook( plan, i )->name );
+            }
+        }
+
+        free( results );
+        cuckooRelease( plan );
+    }
+    cuckooFlushPlans();
+
+    return result;
+}
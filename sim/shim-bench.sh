@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+# shim-bench.sh - compares the cost of invoking a hooked target through the
+# shim with invoking it through the full runner.
+#
+# The same two-hook chain is hooked three ways: with the symlink pointing at the
+# runner (with the shim turned off, so it stays that way), at the shim with the
+# default configuration, which it can run by itself (history included), and at
+# the shim with a configuration that needs the runner (a timeout). The runner
+# re-points the last at itself on its first run, so that row measures the runner
+# again, and shows a re-pointed symlink costs no more than the first. Each is
+# invoked repeatedly, and the average wall-clock time per invocation reported.
+#
+# Both are copied side by side, as they'd be installed. Compare against a runner
+# built as it would be released - 'make bench' builds one - as one built with
+# AddressSanitizer is several times slower, which flatters the shim.
+#
+# usage: shim-bench.sh <path to cuckoo> <path to cuckoo-shim> [<invocations>]
+#
+# MIT Licensed
+
+set -u
+
+invocations=${3:-1000}
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/cuckoo-bench.XXXXXX")
+trap 'rm -rf "$work"' EXIT INT TERM
+
+# the shim hands off to the 'cuckoo' beside it
+mkdir "$work/bin"
+cp "${1:?usage: $0 <path to cuckoo> <path to cuckoo-shim> [<invocations>]}" "$work/bin/cuckoo" || exit 1
+cp "${2:?usage: $0 <path to cuckoo> <path to cuckoo-shim> [<invocations>]}" "$work/bin/cuckoo-shim" || exit 1
+cuckoo="$work/bin/cuckoo"
+shim="$work/bin/cuckoo-shim"
+
+if grep -q __asan_init "$cuckoo"; then
+    echo "warning: $1 was built with AddressSanitizer, so the shim will look better than it is"
+fi
+echo "the shim is $(wc -c < "$shim") bytes, the runner $(wc -c < "$cuckoo")"
+
+# the defaults, which the shim can run by itself - only kept out of the system's directories...
+cat > "$work/plain.conf" <<CONF
+commonDir    = $work/etc
+history.file = $work/history
+status.dir   = $work/status
+CONF
+
+# ...and the same, but with a timeout, which needs the runner
+{ cat "$work/plain.conf"; echo "timeout = 1h"; } > "$work/timeout.conf"
+
+# ...and the same, but with the shim off, so the runner leaves the symlink pointing at itself
+{ cat "$work/plain.conf"; echo "shim = off"; } > "$work/noshim.conf"
+
+hooks=$(PATH=/usr/bin:/bin which true)
+
+# hook 'target' in directory '$1', with the symlink pointing at '$2'
+hook() {
+    mkdir -p "$work/$1/.target.d"
+    cp "$hooks" "$work/$1/.target.d/50-target"
+    cp "$hooks" "$work/$1/.target.d/60-extra"
+    ln -s "$2" "$work/$1/target"
+}
+
+hook runner  "$cuckoo"
+hook shim    "$shim"
+hook handoff "$shim"
+
+now_ns() {
+    date +%s%N
+}
+
+# invoke '$work/$1/target' with configuration '$2', and report the average
+bench() {
+    export CUCKOO_CONFIG="$work/$2.conf"
+    # once to warm the caches (and for the runner to write the shim's plan)
+    "$work/$1/target" || { echo "$1: the chain failed"; exit 1; }
+
+    start=$(now_ns)
+    i=0
+    while [ $i -lt "$invocations" ]; do
+        "$work/$1/target"
+        i=$(( i + 1 ))
+    done
+    elapsed=$(( $(now_ns) - start ))
+
+    printf "%-28s %8d us\n" "$3" $(( elapsed / invocations / 1000 ))
+    eval "${1}Ns=$(( elapsed / invocations ))"
+}
+
+echo "$invocations invocations of a two-hook chain, average per invocation:"
+bench runner  noshim  "runner"
+bench shim    plain   "shim"
+bench handoff timeout "runner, with a timeout"
+
+if [ -f "$work/runner/.target.plan" ] || [ ! -f "$work/shim/.target.plan" ] || [ -f "$work/handoff/.target.plan" ]; then
+    echo "the runner didn't write (or remove) the shim's plans as expected"
+    exit 1
+fi
+if [ "$(readlink "$work/runner/target")" != "$cuckoo" ] || [ "$(readlink "$work/shim/target")" != "$shim" ] \
+  || [ "$(readlink "$work/handoff/target")" != "$cuckoo" ]; then
+    echo "the runner didn't point the symlinks at the shim (or back at itself) as expected"
+    exit 1
+fi
+
+echo "the shim takes $(( shimNs * 100 / runnerNs ))% of the runner's time"
@@ -0,0 +1,554 @@
+/**
+ * @file spool.c
+ *
+ * Deferring heavy hooks to a maintenance window.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+
+#include "report.h"
+#include "config.h"
+#include "paths.h"
+#include "history.h"
+#include "spool.h"
+
+const char * getSpoolDir( void )
+{
+    return getConfigString( "spool.dir", kSpoolDir );
+}
+
+/**
+ * @brief
+ * @return the spool directory, creating it if necessary (caller should free), or NULL
+ */
+static char * makeSpoolDir( void )
+{
+    const char * dir     = getSpoolDir();
+    bool         created = ( mkdir( dir, 01777 ) == 0 );
+
+    if ( !created && errno == ENOENT )
+    {
+        /* its parent is missing too */
+        char * made = (char *)makeDirectory( dir );
+        created = ( made != NULL );
+        free( made );
+    }
+    if ( created )
+    {
+        /* every user that might run a windowed hook needs to be able to submit jobs, like /tmp */
+        chmod( dir, 01777 );
+    }
+    return (char *)makeDirectory( dir );
+}
+
+/**
+ * @brief parse 'spool.window', e.g. '01:00-05:00' (local time; may span midnight)
+ * @param start, end minutes past midnight. Equal if there's no window, i.e. any time will do.
+ * @return false if it can't be parsed
+ */
+static bool parseWindow( int * start, int * end )
+{
+    const char * window = getConfigString( "spool.window", NULL );
+    int startHour, startMinute, endHour, endMinute, used = 0;
+
+    *start = *end = 0;
+    if ( window == NULL || *window == '\0' )
+    {
+        return true;
+    }
+    if ( sscanf( window, "%d:%d-%d:%d%n", &startHour, &startMinute, &endHour, &endMinute, &used ) != 4
+      || window[ used ] != '\0'
+      || startHour < 0 || startHour > 23 || startMinute < 0 || startMinute > 59
+      || endHour   < 0 || endHour   > 23 || endMinute   < 0 || endMinute   > 59 )
+    {
+        reportError( "spool.window \'%s\' should look like \'01:00-05:00\'", window );
+        return false;
+    }
+    *start = startHour * 60 + startMinute;
+    *end   = endHour   * 60 + endMinute;
+    return true;
+}
+
+static bool inWindow( int start, int end )
+{
+    time_t    now = time( NULL );
+    struct tm local;
+
+    if ( start == end )
+    {
+        return true;
+    }
+    localtime_r( &now, &local );
+    int minute = local.tm_hour * 60 + local.tm_min;
+
+    return ( start < end ) ? ( minute >= start && minute < end )
+                           : ( minute >= start || minute < end );
+}
+
+/**
+ * @brief make sure what's been written to 'path' (a file or directory) is on disk
+ */
+static bool syncPath( const char * path )
+{
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+    bool result = ( fsync( fd ) == 0 );
+    close( fd );
+    return result;
+}
+
+/**
+ * @brief defer a hook to the maintenance window
+ * @param installPath where the target's symlink is, so the drain can find its hooks again
+ * @param target
+ * @param hook the hook's name
+ * @param argv what it would have been run with - argv[0] is its path
+ * @param vars what earlier hooks in the chain passed on (may be NULL). Not the whole
+ *             environment - the job is run with the drain's.
+ * @param chain the invocation it belongs to
+ * @return false if it couldn't be spooled, so should be run now instead
+ */
+bool spoolSubmit( const char * installPath, const char * target, const char * hook,
+                  char * argv[], char * vars[], uint64_t chain )
+{
+    static unsigned int sequence = 0;
+
+    bool   result = false;
+    char * dir    = makeSpoolDir();
+    char * cwd    = getcwd( NULL, 0 );
+    char * file   = NULL;
+    char * temp   = NULL;
+
+    tSpoolHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header.magic     = kSpoolMagic;
+    header.version   = kSpoolVersion;
+    header.submitted = nowNanoseconds( CLOCK_REALTIME );
+    header.chain     = chain;
+
+    size_t size = sizeof( header ) + strlen( target ) + strlen( hook ) + strlen( installPath )
+                + strlen( argv[0] ) + 4 + strlen( cwd != NULL ? cwd : "/" ) + 1;
+    for ( ; argv[ header.argc ] != NULL; ++header.argc )
+    {
+        size += strlen( argv[ header.argc ] ) + 1;
+    }
+    for ( ; vars != NULL && vars[ header.varc ] != NULL; ++header.varc )
+    {
+        size += strlen( vars[ header.varc ] ) + 1;
+    }
+    header.size = size;
+
+    char * buffer = ( size <= kSpoolMaxSize ) ? malloc( size ) : NULL;
+    if ( dir != NULL && buffer != NULL
+      /* named by submission time, so they sort into the order they were submitted */
+      && asprintf( &file, "%s/%020llu.%d.%u%s", dir, (unsigned long long)header.submitted,
+                   getpid(), sequence, kSpoolSuffix ) >= 0
+      && asprintf( &temp, "%s/.%020llu.%d.%u.tmp", dir, (unsigned long long)header.submitted,
+                   getpid(), sequence++ ) >= 0 )
+    {
+        memcpy( buffer, &header, sizeof( header ) );
+        char * next = buffer + sizeof( header );
+        next = stpcpy( next, target ) + 1;
+        next = stpcpy( next, hook ) + 1;
+        next = stpcpy( next, installPath ) + 1;
+        next = stpcpy( next, argv[0] ) + 1;
+        next = stpcpy( next, cwd != NULL ? cwd : "/" ) + 1;
+        for ( uint32_t i = 0; i < header.argc; ++i )
+        {
+            next = stpcpy( next, argv[i] ) + 1;
+        }
+        for ( uint32_t i = 0; i < header.varc; ++i )
+        {
+            next = stpcpy( next, vars[i] ) + 1;
+        }
+
+        /* durable before it's visible: written and synced to the side, then renamed into place */
+        int fd = open( temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR );
+        if ( fd >= 0 )
+        {
+            result = ( write( fd, buffer, size ) == (ssize_t)size && fsync( fd ) == 0 );
+            close( fd );
+            result = result && rename( temp, file ) == 0 && syncPath( dir );
+            if ( !result )
+            {
+                unlink( temp );
+            }
+        }
+    }
+
+    if ( result )
+    {
+        syslog( LOG_INFO, "%s/%s deferred to the maintenance window", target, hook );
+    }
+    else
+    {
+        syslog( LOG_WARNING, "unable to spool %s/%s, so running it now (%m)", target, hook );
+    }
+
+    free( buffer );
+    free( temp );
+    free( file );
+    free( cwd );
+    free( dir );
+    return result;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+static int isJob( const struct dirent * entry )
+{
+    size_t len       = strlen( entry->d_name );
+    size_t suffixLen = strlen( kSpoolSuffix );
+
+    return ( entry->d_name[0] != '.' && len > suffixLen
+          && strcmp( &entry->d_name[ len - suffixLen ], kSpoolSuffix ) == 0 );
+}
+
+static void freeJob( tSpoolJob * job )
+{
+    free( job->file );
+    free( job->argv );
+    free( job->vars );
+    free( job->strings );
+    memset( job, 0, sizeof( tSpoolJob ) );
+}
+
+/**
+ * @brief read a job from the spool
+ * @param file
+ * @param job its owner is noted, as that's who it'll be run as
+ * @return false if it couldn't be read, or isn't a job
+ */
+static bool loadJob( const char * file, tSpoolJob * job )
+{
+    struct stat info;
+
+    memset( job, 0, sizeof( tSpoolJob ) );
+    /* not through a symlink, nor a hard link to someone else's file */
+    int fd = open( file, O_RDONLY | O_NOFOLLOW | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+    if ( fstat( fd, &info ) != 0 || !S_ISREG( info.st_mode ) || info.st_nlink != 1
+      || info.st_size <= (off_t)sizeof( tSpoolHeader ) || info.st_size > kSpoolMaxSize
+      || read( fd, &job->header, sizeof( tSpoolHeader ) ) != sizeof( tSpoolHeader )
+      || job->header.magic != kSpoolMagic || job->header.version != kSpoolVersion
+      || job->header.size != (uint64_t)info.st_size )
+    {
+        close( fd );
+        return false;
+    }
+
+    size_t size  = info.st_size - sizeof( tSpoolHeader );
+    job->strings = malloc( size );
+    job->argv    = calloc( job->header.argc + 1, sizeof( char * ) );
+    job->vars    = calloc( job->header.varc + 1, sizeof( char * ) );
+    job->file    = strdup( file );
+    job->uid     = info.st_uid;
+    job->gid     = info.st_gid;
+    bool result  = ( job->strings != NULL && job->argv != NULL && job->vars != NULL && job->file != NULL
+                  && read( fd, job->strings, size ) == (ssize_t)size && job->strings[ size - 1 ] == '\0' );
+    close( fd );
+
+    /* point into the strings, making sure there are as many as the header says */
+    char *   next  = job->strings;
+    char *   end   = job->strings + size;
+    uint32_t count = 5 + job->header.argc + job->header.varc;
+    for ( uint32_t i = 0; result && i < count; ++i )
+    {
+        if ( next >= end )
+        {
+            result = false;
+            break;
+        }
+        switch ( i )
+        {
+        case 0: job->target      = next; break;
+        case 1: job->hook        = next; break;
+        case 2: job->installPath = next; break;
+        case 3: job->path        = next; break;
+        case 4: job->cwd         = next; break;
+        default:
+            if ( i - 5 < job->header.argc )
+            {
+                job->argv[ i - 5 ] = next;
+            }
+            else
+            {
+                job->vars[ i - 5 - job->header.argc ] = next;
+            }
+            break;
+        }
+        next += strlen( next ) + 1;
+    }
+
+    if ( !result || job->header.argc == 0 )
+    {
+        freeJob( job );
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief become the job's owner, if we're root. Called in the child, before it's run.
+ * @param job
+ * @return false if we couldn't, so it mustn't be run
+ */
+static bool becomeOwner( const tSpoolJob * job )
+{
+    if ( geteuid() != 0 || job->uid == 0 )
+    {
+        return true;
+    }
+
+    struct passwd * user = getpwuid( job->uid );
+    bool result = ( ( user != NULL ) ? initgroups( user->pw_name, job->gid )
+                                     : setgroups( 0, NULL ) ) == 0
+               && setgid( job->gid ) == 0
+               && setuid( job->uid ) == 0;
+    if ( !result )
+    {
+        syslog( LOG_ERR, "err: unable to run '%s' as uid %u (%m)", job->file, (unsigned int)job->uid );
+    }
+    return result;
+}
+
+/**
+ * @brief how many jobs are waiting in the spool
+ * @param oldest set to how long the oldest of them has waited, in nanoseconds
+ * @return number of jobs
+ */
+int spoolBacklog( uint64_t * oldest )
+{
+    struct dirent ** entries = NULL;
+
+    *oldest = 0;
+    int count = scandir( getSpoolDir(), &entries, isJob, alphasort );
+    if ( count <= 0 )
+    {
+        return 0;
+    }
+
+    /* the name starts with when it was submitted */
+    uint64_t submitted = strtoull( entries[0]->d_name, NULL, 10 );
+    uint64_t now       = nowNanoseconds( CLOCK_REALTIME );
+    if ( submitted > 0 && now > submitted )
+    {
+        *oldest = now - submitted;
+    }
+
+    for ( int i = 0; i < count; ++i )
+    {
+        free( entries[i] );
+    }
+    free( entries );
+    return count;
+}
+
+/**
+ * @brief implements 'cuckoo --drain-spool [--force]' - runs the spooled jobs in the order they were
+ *        submitted, up to 'spool.parallel' at a time, until the spool is empty or the window closes.
+ *        Jobs already running when the window closes are allowed to finish. Each job runs as
+ *        the owner of its file; jobs we can't become the owner of are left for one who can.
+ * @param argc
+ * @param argv the arguments following '--drain-spool'
+ * @return exit code
+ */
+int drainSpool( int argc, char * argv[] )
+{
+    bool force = false;
+    int  start, end;
+
+    for ( int i = 0; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "--force" ) == 0 )
+        {
+            force = true;
+        }
+        else
+        {
+            reportError( "unexpected argument \'%s\'", argv[i] );
+            return -1;
+        }
+    }
+
+    if ( !parseWindow( &start, &end ) )
+    {
+        return -1;
+    }
+    if ( !force && !inWindow( start, end ) )
+    {
+        printf( "outside the maintenance window (%s), nothing run\n", getConfigString( "spool.window", "" ) );
+        return 0;
+    }
+
+    const char * dir = getSpoolDir();
+    char * lockPath = NULL;
+    if ( asprintf( &lockPath, "%s/%s", dir, kSpoolLockName ) < 0 )
+    {
+        return reportErrno( "unable to allocate memory" );
+    }
+    int lockFd = open( lockPath, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR );
+    free( lockPath );
+    if ( lockFd < 0 )
+    {
+        if ( errno == ENOENT )
+        {
+            printf( "nothing has been spooled\n" );
+            return 0;
+        }
+        return reportErrno( "unable to lock the spool in \'%s\'", dir );
+    }
+    if ( flock( lockFd, LOCK_EX | LOCK_NB ) != 0 )
+    {
+        close( lockFd );
+        printf( "the spool is already being drained\n" );
+        return 0;
+    }
+
+    struct dirent ** entries = NULL;
+    int count = scandir( dir, &entries, isJob, alphasort );
+
+    long parallel = getConfigNumber( "spool.parallel", kSpoolParallel );
+    if ( parallel < 1 )
+    {
+        parallel = 1;
+    }
+    pid_t * pids  = calloc( parallel, sizeof( pid_t ) );
+    char ** files = calloc( parallel, sizeof( char * ) );
+    long    running = 0;
+    bool    starting = true;
+    int     next    = 0;
+    int     ran     = 0;
+    int     failed  = 0;
+    int     skipped = 0;
+
+    while ( pids != NULL && files != NULL )
+    {
+        if ( starting && running < parallel && next < count && ( force || inWindow( start, end ) ) )
+        {
+            char * file = NULL;
+            asprintf( &file, "%s/%s", dir, entries[ next++ ]->d_name );
+
+            tSpoolJob job;
+            if ( file == NULL || !loadJob( file, &job ) )
+            {
+                /* set it aside, rather than having it block the spool */
+                char * bad = NULL;
+                if ( file != NULL && asprintf( &bad, "%s.bad", file ) >= 0 )
+                {
+                    syslog( LOG_ERR, "err: \'%s\' isn't a valid job, renamed to \'%s\'", file, bad );
+                    rename( file, bad );
+                }
+                free( bad );
+                free( file );
+                continue;
+            }
+            if ( geteuid() != 0 && job.uid != geteuid() )
+            {
+                /* someone else's - only they (or root) may run it */
+                syslog( LOG_NOTICE, "'%s' belongs to uid %u, so left in the spool",
+                        file, (unsigned int)job.uid );
+                freeJob( &job );
+                free( file );
+                ++skipped;
+                continue;
+            }
+
+            pid_t pid = fork();
+            if ( pid == 0 )
+            {
+                close( lockFd );
+                _exit( becomeOwner( &job ) ? spoolRunJob( &job ) : 126 );
+            }
+            freeJob( &job );
+            if ( pid < 0 )
+            {
+                /* it stays spooled for next time - just let those running finish */
+                syslog( LOG_ERR, "err: unable to run \'%s\' (%m)", file );
+                free( file );
+                starting = false;
+                --next;
+                continue;
+            }
+
+            for ( long i = 0; i < parallel; ++i )
+            {
+                if ( pids[i] == 0 )
+                {
+                    pids[i]  = pid;
+                    files[i] = file;
+                    break;
+                }
+            }
+            ++running;
+        }
+        else if ( running > 0 )
+        {
+            int   status;
+            pid_t pid = wait( &status );
+            if ( pid < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                break;
+            }
+            for ( long i = 0; i < parallel; ++i )
+            {
+                if ( pids[i] == pid )
+                {
+                    /* it's run, whatever the outcome - that's in the history */
+                    unlink( files[i] );
+                    free( files[i] );
+                    pids[i]  = 0;
+                    files[i] = NULL;
+                    --running;
+                    ++ran;
+                    failed += !( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+                    break;
+                }
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    printf( "ran %d spooled job%s (%d failed), %d left\n", ran, ran == 1 ? "" : "s", failed,
+            ( count > 0 ? count : 0 ) - next + skipped );
+
+    for ( int i = 0; i < count; ++i )
+    {
+        free( entries[i] );
+    }
+    free( entries );
+    free( files );
+    free( pids );
+    close( lockFd );
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file spool.h
+ *
+ * Deferring heavy hooks to a maintenance window. A hook with 'windowed = on'
+ * isn't run when its chain is - instead a job (the hook, its working directory,
+ * arguments and whatever earlier hooks passed on) is written to the spool
+ * directory, and the chain carries on without it. 'cuckoo --drain-spool', run
+ * from cron or a timer, runs the spooled jobs in the order they were submitted,
+ * a few at a time, but only while within 'spool.window'.
+ *
+ * The spool is written by whoever runs the hooked target, so it's created sticky
+ * and world-writable, like /tmp, and may be drained by
+ * root, so a job is trusted no further than its file's owner: it runs as that
+ * user, only if it names a hook the target really has, and with the drain's own
+ * environment plus nothing but valid hook data variables.
+ *
+ * A job is removed once it has run (whatever its outcome, which is in the
+ * history), so if the drain is interrupted, the jobs it hadn't finished run the
+ * next time.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_SPOOL_H
+#define CUCKOO_SPOOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define kSpoolDir           "/var/spool/cuckoo"
+#define kSpoolMagic         0x626f4a63      /* 'cJob' */
+#define kSpoolVersion       2
+#define kSpoolSuffix        ".job"
+#define kSpoolLockName      ".lock"
+#define kSpoolMaxSize       ( 1024 * 1024 )
+#define kSpoolParallel      1
+
+/* a job file is this header, followed by NUL-terminated strings: the target, the
+ * hook's name, the target's install path, the hook's path, the working directory,
+ * 'argc' arguments, then 'varc' variables passed on by earlier hooks */
+typedef struct {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  size;         /* of the whole file */
+    uint32_t  argc;
+    uint32_t  varc;
+    uint32_t  reserved;
+    uint64_t  submitted;    /* CLOCK_REALTIME, in nanoseconds */
+    uint64_t  chain;        /* of the invocation that submitted it */
+} tSpoolHeader;
+
+typedef struct {
+    tSpoolHeader  header;
+    char *        file;     /* where it was spooled */
+    char *        target;
+    char *        hook;
+    char *        installPath;
+    char *        path;
+    char *        cwd;
+    char **       argv;     /* NULL-terminated; argv[0] is the hook's path */
+    char **       vars;     /* NULL-terminated 'KEY=value's, as yet unchecked */
+    char *        strings;  /* what the pointers above point into */
+    uid_t         uid;      /* the job file's owner, who it runs as */
+    gid_t         gid;
+} tSpoolJob;
+
+const char * getSpoolDir( void );
+bool spoolSubmit( const char * installPath, const char * target, const char * hook,
+                  char * argv[], char * vars[], uint64_t chain );
+int  spoolBacklog( uint64_t * oldest );
+int  drainSpool( int argc, char * argv[] );
+
+/* in libcuckoo.c, alongside the launcher */
+int  spoolRunJob( const tSpoolJob * job );
+
+#endif /* CUCKOO_SPOOL_H */
@@ -0,0 +1,830 @@
+/**
+ * @file verify.c
+ *
+ * Health checks for hooks, and the manifest that records their verdicts.
+ *
+ * MIT Licensed
+ */
+
+#define _GNU_SOURCE            1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <syslog.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <elf.h>
+#include <pwd.h>
+#include <grp.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/close_range.h>
+
+#include "report.h"
+#include "config.h"
+#include "history.h"
+#include "spool.h"
+#include "verify.h"
+
+struct sManifestEntry {
+    struct sManifestEntry * next;
+    ino_t                   inode;
+    off_t                   size;
+    uint64_t                changed;    /* st_ctim - covers both edits and chmod */
+    char *                  reason;
+    char                    path[1];
+};
+
+typedef struct {
+    const char * name;
+    uid_t        uid;
+    gid_t        gid;
+    gid_t        groups[ 64 ];
+    int          groupCount;
+} tRunUser;
+
+typedef enum {
+    kVerdictOk,
+    kVerdictBad,
+    kVerdictDisabled
+} tVerdict;
+
+static const char * verdictNames[] = { "ok", "bad", "off" };
+
+static uint64_t changeTime( const struct stat * info )
+{
+    return (uint64_t)info->st_ctim.tv_sec * 1000000000 + info->st_ctim.tv_nsec;
+}
+
+/**
+ * @brief read the verdicts recorded by the last verification. Only the bad ones are kept.
+ * @param scriptsDir
+ * @return NULL if there is no manifest
+ */
+tManifest * loadManifest( const char * scriptsDir )
+{
+    char * path = NULL;
+    asprintf( &path, "%s/%s", scriptsDir, kManifestName );
+    if ( path == NULL )
+    {
+        return NULL;
+    }
+
+    FILE * file = fopen( path, "re" );
+    free( path );
+    if ( file == NULL )
+    {
+        return NULL;
+    }
+
+    tManifest * manifest = calloc( 1, sizeof( tManifest ) );
+
+    char * line    = NULL;
+    size_t lineLen = 0;
+    while ( manifest != NULL && getline( &line, &lineLen, file ) > 0 )
+    {
+        /* <verdict> \t <inode> \t <size> \t <ctime> \t <path> \t <reason> */
+        line[ strcspn( line, "\n" ) ] = '\0';
+
+        char * fields[6];
+        char * cursor = line;
+        int    count  = 0;
+        while ( count < 6 && cursor != NULL )
+        {
+            fields[ count++ ] = strsep( &cursor, "\t" );
+        }
+
+        if ( count < 6 || strcmp( fields[0], verdictNames[ kVerdictBad ] ) != 0 )
+        {
+            continue;
+        }
+
+        size_t pathLen = strlen( fields[4] );
+        tManifestEntry * entry = calloc( 1, sizeof( tManifestEntry ) + pathLen + strlen( fields[5] ) + 1 );
+        if ( entry != NULL )
+        {
+            entry->inode   = strtoull( fields[1], NULL, 10 );
+            entry->size    = strtoll(  fields[2], NULL, 10 );
+            entry->changed = strtoull( fields[3], NULL, 10 );
+            memcpy( entry->path, fields[4], pathLen );
+            entry->reason  = &entry->path[ pathLen + 1 ];
+            strcpy( entry->reason, fields[5] );
+
+            entry->next    = manifest->head;
+            manifest->head = entry;
+        }
+    }
+
+    free( line );
+    fclose( file );
+    return manifest;
+}
+
+/**
+ * @brief should this hook be skipped? Only if it was found to be broken, and hasn't changed since.
+ * @param manifest may be NULL
+ * @param path
+ * @param info the hook's current stat
+ * @return
+ */
+bool manifestSkip( const tManifest * manifest, const char * path, const struct stat * info )
+{
+    if ( manifest != NULL )
+    {
+        for ( const tManifestEntry * entry = manifest->head; entry != NULL; entry = entry->next )
+        {
+            if ( strcmp( entry->path, path ) == 0 )
+            {
+                if ( entry->inode == info->st_ino && entry->size == info->st_size
+                  && entry->changed == changeTime( info ) )
+                {
+                    syslog( LOG_ERR, "skipping \'%s\': %s", path, entry->reason );
+                    return true;
+                }
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+void freeManifest( tManifest * manifest )
+{
+    if ( manifest != NULL )
+    {
+        tManifestEntry * entry = manifest->head;
+        while ( entry != NULL )
+        {
+            tManifestEntry * f = entry;
+            entry = entry->next;
+            free( f );
+        }
+        free( manifest );
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief would 'user' be granted 'mode' (R_OK, W_OK or X_OK) to this file?
+ */
+static bool userCan( const tRunUser * user, const struct stat * info, int mode )
+{
+    if ( user->uid == 0 )
+    {
+        /* root can read or write anything, but still needs at least one execute bit */
+        return ( mode != X_OK ) || ( info->st_mode & ( S_IXUSR | S_IXGRP | S_IXOTH ) ) != 0;
+    }
+
+    /* the bit for 'other', shifted up for the owner or the group */
+    mode_t bits = ( mode == X_OK ) ? S_IXOTH : ( mode == W_OK ) ? S_IWOTH : S_IROTH;
+    if ( info->st_uid == user->uid )
+    {
+        bits <<= 6;
+    }
+    else
+    {
+        bool inGroup = false;
+        for ( int i = 0; i < user->groupCount && !inGroup; ++i )
+        {
+            inGroup = ( user->groups[i] == info->st_gid );
+        }
+        if ( inGroup )
+        {
+            bits <<= 3;
+        }
+    }
+    return ( info->st_mode & bits ) != 0;
+}
+
+/**
+ * @brief can 'user' search every directory leading to 'path', and then access the file itself?
+ * @return NULL if so, otherwise a description of the problem (caller should free)
+ */
+static char * checkAccess( const tRunUser * user, const char * path, int mode )
+{
+    char *      result = NULL;
+    struct stat info;
+
+    char * prefix = strdup( path );
+    for ( char * slash = strchr( prefix + 1, '/' ); slash != NULL && result == NULL; slash = strchr( slash + 1, '/' ) )
+    {
+        *slash = '\0';
+        if ( stat( prefix, &info ) == 0 && !userCan( user, &info, X_OK ) )
+        {
+            asprintf( &result, "user \'%s\' can't search directory \'%s\'", user->name, prefix );
+        }
+        *slash = '/';
+    }
+    free( prefix );
+
+    if ( result == NULL )
+    {
+        if ( stat( path, &info ) != 0 )
+        {
+            asprintf( &result, "\'%s\' not found", path );
+        }
+        else if ( !userCan( user, &info, mode ) )
+        {
+            asprintf( &result, "user \'%s\' doesn't have %s permission on \'%s\'",
+                      user->name, ( mode == X_OK ) ? "execute" : ( mode == W_OK ) ? "write" : "read", path );
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief can 'user' submit jobs to the spool - or create it, if it doesn't exist yet?
+ * @return NULL if so, otherwise a description of the problem (caller should free)
+ */
+static char * checkSpool( const tRunUser * user )
+{
+    char *       result = NULL;
+    const char * dir    = getSpoolDir();
+
+    if ( access( dir, F_OK ) == 0 )
+    {
+        result = checkAccess( user, dir, W_OK );
+        if ( result == NULL )
+        {
+            result = checkAccess( user, dir, X_OK );
+        }
+    }
+    else
+    {
+        /* it'll be created by the first job submitted, along with any missing parents */
+        char * parent  = strdup( dir );
+        char * nearest = ( parent != NULL ) ? dirname( parent ) : NULL;
+        while ( nearest != NULL && access( nearest, F_OK ) != 0 && strcmp( nearest, "/" ) != 0 )
+        {
+            nearest = dirname( nearest );
+        }
+        if ( nearest != NULL )
+        {
+            result = checkAccess( user, nearest, W_OK );
+        }
+        free( parent );
+    }
+    return result;
+}
+
+/**
+ * @brief find 'program' on the PATH, as /usr/bin/env would
+ * @return absolute path (caller should free), or NULL
+ */
+static char * searchPath( const char * program )
+{
+    const char * pathVar = getenv( "PATH" );
+    char * paths = strdup( pathVar != NULL ? pathVar : "/usr/local/bin:/usr/bin:/bin" );
+    char * result = NULL;
+
+    char * cursor = paths;
+    char * dir;
+    while ( result == NULL && ( dir = strsep( &cursor, ":" ) ) != NULL )
+    {
+        char * candidate = NULL;
+        asprintf( &candidate, "%s/%s", *dir != '\0' ? dir : ".", program );
+        if ( candidate != NULL && access( candidate, F_OK ) == 0 )
+        {
+            result = candidate;
+        }
+        else
+        {
+            free( candidate );
+        }
+    }
+    free( paths );
+    return result;
+}
+
+/**
+ * @brief check that an ELF executable's program interpreter (dynamic loader) exists
+ * @return NULL if it's fine, otherwise a description of the problem (caller should free)
+ */
+static char * checkElf( const tRunUser * user, int fd, const unsigned char * ident )
+{
+    char * result   = NULL;
+    off_t  phoff    = 0;
+    int    phnum    = 0;
+    int    phentsize = 0;
+
+    if ( ident[ EI_CLASS ] == ELFCLASS64 )
+    {
+        Elf64_Ehdr header;
+        if ( pread( fd, &header, sizeof( header ), 0 ) == sizeof( header ) )
+        {
+            phoff = header.e_phoff; phnum = header.e_phnum; phentsize = header.e_phentsize;
+        }
+    }
+    else if ( ident[ EI_CLASS ] == ELFCLASS32 )
+    {
+        Elf32_Ehdr header;
+        if ( pread( fd, &header, sizeof( header ), 0 ) == sizeof( header ) )
+        {
+            phoff = header.e_phoff; phnum = header.e_phnum; phentsize = header.e_phentsize;
+        }
+    }
+
+    for ( int i = 0; i < phnum && result == NULL; ++i )
+    {
+        uint32_t type;
+        off_t    offset;
+        size_t   size;
+        union {
+            Elf64_Phdr h64;
+            Elf32_Phdr h32;
+        } ph;
+
+        if ( pread( fd, &ph, phentsize < (int)sizeof( ph ) ? phentsize : (int)sizeof( ph ),
+                    phoff + (off_t)i * phentsize ) <= 0 )
+        {
+            break;
+        }
+        if ( ident[ EI_CLASS ] == ELFCLASS64 )
+        {
+            type = ph.h64.p_type; offset = ph.h64.p_offset; size = ph.h64.p_filesz;
+        }
+        else
+        {
+            type = ph.h32.p_type; offset = ph.h32.p_offset; size = ph.h32.p_filesz;
+        }
+
+        if ( type == PT_INTERP && size > 0 && size < PATH_MAX )
+        {
+            char interpreter[ PATH_MAX ];
+            if ( pread( fd, interpreter, size, offset ) == (ssize_t)size )
+            {
+                interpreter[ size - 1 ] = '\0';
+                char * problem = checkAccess( user, interpreter, X_OK );
+                if ( problem != NULL )
+                {
+                    asprintf( &result, "dynamic loader unusable: %s", problem );
+                    free( problem );
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief check a '#!' line: the interpreter must exist and be executable by the user
+ * @return NULL if it's fine, otherwise a description of the problem (caller should free)
+ */
+static char * checkShebang( const tRunUser * user, char * line )
+{
+    char * result = NULL;
+
+    if ( strchr( line, '\r' ) != NULL )
+    {
+        return strdup( "the \'#!\' line ends with a carriage return (DOS line endings)" );
+    }
+
+    char * cursor      = line + 2;
+    char * interpreter = strsep( &cursor, " \t" );
+    while ( interpreter != NULL && *interpreter == '\0' )
+    {
+        /* spaces between '#!' and the interpreter are allowed */
+        interpreter = strsep( &cursor, " \t" );
+    }
+
+    if ( interpreter == NULL || *interpreter == '\0' )
+    {
+        return strdup( "the \'#!\' line doesn't name an interpreter" );
+    }
+    if ( *interpreter != '/' )
+    {
+        asprintf( &result, "interpreter \'%s\' isn't an absolute path", interpreter );
+        return result;
+    }
+
+    char * problem = checkAccess( user, interpreter, X_OK );
+    if ( problem != NULL )
+    {
+        asprintf( &result, "interpreter unusable: %s", problem );
+        free( problem );
+    }
+    else if ( strcmp( strrchr( interpreter, '/' ), "/env" ) == 0 && cursor != NULL )
+    {
+        /* '#!/usr/bin/env python3' - the real interpreter comes from the PATH */
+        char * program = strsep( &cursor, " \t" );
+        while ( program != NULL && ( *program == '\0' || *program == '-' ) )
+        {
+            program = strsep( &cursor, " \t" );
+        }
+        if ( program != NULL )
+        {
+            char * found = ( *program == '/' ) ? strdup( program ) : searchPath( program );
+            if ( found == NULL )
+            {
+                asprintf( &result, "interpreter \'%s\' isn't on the PATH", program );
+            }
+            else
+            {
+                problem = checkAccess( user, found, X_OK );
+                if ( problem != NULL )
+                {
+                    asprintf( &result, "interpreter unusable: %s", problem );
+                    free( problem );
+                }
+                free( found );
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief can smoke runs be made as 'user'? Only if they're who we are, or we're root.
+ */
+static bool canSmokeAs( const tRunUser * user )
+{
+    return ( geteuid() == 0 || geteuid() == user->uid );
+}
+
+/**
+ * @brief run the hook with harmless arguments, to prove it can actually start
+ * @param user who to run it as, if canSmokeAs() them - otherwise it's run as us
+ * @param path
+ * @return NULL if it ran, otherwise a description of the problem (caller should free)
+ */
+static char * smokeTest( const tRunUser * user, const char * path )
+{
+    char * result = NULL;
+    int    execPipe[2];
+
+    char * args = strdup( getConfigString( "verify.smokeArgs", kSmokeArgs ) );
+    char * argv[16] = { (char *)path };
+    int    argc = 1;
+    char * cursor = args;
+    char * arg;
+    while ( argc < 15 && ( arg = strsep( &cursor, " \t" ) ) != NULL )
+    {
+        if ( *arg != '\0' )
+        {
+            argv[ argc++ ] = arg;
+        }
+    }
+
+    if ( pipe2( execPipe, O_CLOEXEC ) != 0 )
+    {
+        free( args );
+        return strdup( "unable to create a pipe" );
+    }
+
+    pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        int devNull = open( "/dev/null", O_RDWR | O_CLOEXEC );
+        dup2( devNull, STDIN_FILENO );
+        dup2( devNull, STDOUT_FILENO );
+        dup2( devNull, STDERR_FILENO );
+        syscall( SYS_close_range, STDERR_FILENO + 1, ~0U, CLOSE_RANGE_CLOEXEC );
+        setpgid( 0, 0 );
+        if ( geteuid() == 0 && user->uid != 0
+          && ( setgroups( user->groupCount, user->groups ) != 0 || setgid( user->gid ) != 0 || setuid( user->uid ) != 0 ) )
+        {
+            /* better to fail than to vouch for it as root */
+            int error = errno;
+            write( execPipe[1], &error, sizeof( error ) );
+            _exit( 127 );
+        }
+        execv( path, argv );
+
+        /* only reached if the exec failed - tell the parent why */
+        int error = errno;
+        write( execPipe[1], &error, sizeof( error ) );
+        _exit( 127 );
+    }
+    close( execPipe[1] );
+
+    if ( pid < 0 )
+    {
+        result = strdup( "unable to fork" );
+    }
+    else
+    {
+        int status = 0;
+        int waited = 0;
+        while ( waitpid( pid, &status, WNOHANG ) == 0 )
+        {
+            if ( waited++ >= kSmokeTimeout * 20 )
+            {
+                kill( -pid, SIGKILL );
+                waitpid( pid, &status, 0 );
+                printf( "      (smoke run of \'%s\' didn't finish within %ds)\n", path, kSmokeTimeout );
+                status = 0;
+                break;
+            }
+            struct timespec tick = { 0, 50 * 1000000 };
+            nanosleep( &tick, NULL );
+        }
+
+        int error = 0;
+        if ( read( execPipe[0], &error, sizeof( error ) ) == sizeof( error ) )
+        {
+            asprintf( &result, "exec failed: %s", strerror( error ) );
+        }
+        else if ( WIFSIGNALED( status ) && WTERMSIG( status ) != SIGKILL )
+        {
+            asprintf( &result, "smoke run was killed by signal %d", WTERMSIG( status ) );
+        }
+        else if ( WIFEXITED( status ) && ( WEXITSTATUS( status ) == 126 || WEXITSTATUS( status ) == 127 ) )
+        {
+            asprintf( &result, "smoke run exited with %d (command not found or not executable)",
+                      WEXITSTATUS( status ) );
+        }
+    }
+    close( execPipe[0] );
+    free( args );
+
+    return result;
+}
+
+/**
+ * @brief check one hook
+ * @param reason set to a description of any problem (caller should free)
+ */
+static tVerdict checkHook( const tRunUser * user, const char * path, const struct stat * info,
+                           bool smoke, char ** reason )
+{
+    *reason = NULL;
+
+    if ( ( info->st_mode & ( S_IXUSR | S_IXGRP | S_IXOTH ) ) == 0 )
+    {
+        /* nobody can execute it, so it's been deliberately disabled (or it's not a hook at all) */
+        *reason = strdup( "not executable" );
+        return kVerdictDisabled;
+    }
+
+    *reason = checkAccess( user, path, X_OK );
+    if ( *reason != NULL )
+    {
+        return kVerdictBad;
+    }
+
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        asprintf( reason, "unable to read it (%s)", strerror( errno ) );
+        return kVerdictBad;
+    }
+
+    char    header[ 256 ];
+    ssize_t len = read( fd, header, sizeof( header ) - 1 );
+    header[ len > 0 ? len : 0 ] = '\0';
+
+    if ( len >= SELFMAG && memcmp( header, ELFMAG, SELFMAG ) == 0 )
+    {
+        *reason = checkElf( user, fd, (unsigned char *)header );
+    }
+    else if ( len >= 2 && header[0] == '#' && header[1] == '!' )
+    {
+        header[ strcspn( header, "\n" ) ] = '\0';
+        *reason = checkShebang( user, header );
+        if ( *reason == NULL )
+        {
+            /* the interpreter has to be able to read the script */
+            *reason = checkAccess( user, path, R_OK );
+        }
+    }
+    else
+    {
+        *reason = strdup( "neither a \'#!\' script nor an ELF executable - exec would fail" );
+    }
+    close( fd );
+
+    if ( *reason == NULL && smoke )
+    {
+        *reason = smokeTest( user, path );
+    }
+
+    return ( *reason == NULL ) ? kVerdictOk : kVerdictBad;
+}
+
+typedef struct {
+    char *      path;
+    const char * name;
+    struct stat info;
+} tHook;
+
+static int compareHooks( const void * a, const void * b )
+{
+    return strcoll( ((const tHook *)a)->name, ((const tHook *)b)->name );
+}
+
+/**
+ * @brief add the regular files in 'dir' to the list of hooks
+ */
+static void listHooks( const char * dir, tHook ** hooks, size_t * count )
+{
+    DIR * dirp = opendir( dir );
+    if ( dirp == NULL )
+    {
+        return;
+    }
+
+    struct dirent * entry;
+    while ( ( entry = readdir( dirp ) ) != NULL )
+    {
+        if ( entry->d_name[0] == '.' )
+        {
+            continue;
+        }
+
+        tHook hook;
+        asprintf( &hook.path, "%s/%s", dir, entry->d_name );
+        if ( hook.path == NULL || stat( hook.path, &hook.info ) != 0 || !S_ISREG( hook.info.st_mode ) )
+        {
+            free( hook.path );
+            continue;
+        }
+        hook.name = strrchr( hook.path, '/' ) + 1;
+
+        tHook * grown = realloc( *hooks, ( *count + 1 ) * sizeof( tHook ) );
+        if ( grown == NULL )
+        {
+            free( hook.path );
+            break;
+        }
+        *hooks = grown;
+        (*hooks)[ (*count)++ ] = hook;
+    }
+    closedir( dirp );
+}
+
+/**
+ * @brief work out who the hooks will run as
+ * @param name user name, or NULL to use the owner of the directory the hooked executable is in
+ */
+static bool getRunUser( const char * name, const char * installPath, tRunUser * user )
+{
+    struct passwd * pw;
+
+    if ( name != NULL )
+    {
+        pw = getpwnam( name );
+        if ( pw == NULL )
+        {
+            reportError( "unknown user \'%s\'", name );
+            return false;
+        }
+    }
+    else
+    {
+        /* Channels DVR runs as whoever owns its install directory */
+        char * dir = strdup( installPath );
+        char * slash = strrchr( dir, '/' );
+        if ( slash != NULL )
+        {
+            *slash = '\0';
+        }
+
+        struct stat dirStat;
+        uid_t uid = ( stat( *dir != '\0' ? dir : "/", &dirStat ) == 0 ) ? dirStat.st_uid : geteuid();
+        free( dir );
+
+        pw = getpwuid( uid );
+        if ( pw == NULL )
+        {
+            reportError( "no user with uid %d", uid );
+            return false;
+        }
+    }
+
+    user->name       = strdup( pw->pw_name );
+    user->uid        = pw->pw_uid;
+    user->gid        = pw->pw_gid;
+    user->groupCount = sizeof( user->groups ) / sizeof( user->groups[0] );
+    if ( getgrouplist( pw->pw_name, pw->pw_gid, user->groups, &user->groupCount ) < 0 )
+    {
+        /* more groups than we have room for - the first 64 will have to do */
+        user->groupCount = sizeof( user->groups ) / sizeof( user->groups[0] );
+    }
+    return true;
+}
+
+/**
+ * @brief check every hook of a target, print the results and record them in the manifest
+ * @param installPath the hooked executable (i.e. the symlink to cuckoo)
+ * @param scriptsDir
+ * @param commonDir
+ * @param userName who the hooks will run as, or NULL to infer it
+ * @param smoke also try running each hook
+ * @return 0 if every hook looks fine, 1 if any are broken, otherwise an errno value
+ */
+int verifyHooks( const char * installPath, const char * scriptsDir, const char * commonDir,
+                 const char * userName, bool smoke )
+{
+    tRunUser user;
+    if ( !getRunUser( userName != NULL ? userName : getConfigString( "verify.user", NULL ), installPath, &user ) )
+    {
+        return -1;
+    }
+
+    tHook * hooks = NULL;
+    size_t  count = 0;
+    listHooks( scriptsDir, &hooks, &count );
+    listHooks( commonDir,  &hooks, &count );
+    qsort( hooks, count, sizeof( tHook ), compareHooks );
+
+    char * manifestPath = NULL;
+    char * tempPath     = NULL;
+    asprintf( &manifestPath, "%s/%s", scriptsDir, kManifestName );
+    asprintf( &tempPath, "%s.tmp", manifestPath );
+    FILE * manifest = fopen( tempPath, "we" );
+    if ( manifest == NULL )
+    {
+        reportErrno( "unable to write \'%s\'", tempPath );
+    }
+
+    printf( "verifying the hooks of \'%s\' for user \'%s\':\n", installPath, user.name );
+    if ( smoke )
+    {
+        /* say what the smoke runs don't cover */
+        struct passwd * me = getpwuid( geteuid() );
+        if ( !canSmokeAs( &user ) )
+        {
+            printf( "  (smoke runs are as \'%s\', not \'%s\' - only root can make them as another user)\n",
+                    me != NULL ? me->pw_name : "?", user.name );
+        }
+        printf( "  (smoke runs get this environment, PATH included, not the one the target runs with)\n" );
+    }
+
+    int bad = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        char *   reason  = NULL;
+        tVerdict verdict = checkHook( &user, hooks[i].path, &hooks[i].info, smoke, &reason );
+
+        /* a smoke run may have changed nothing, but be sure the manifest matches what's there now */
+        stat( hooks[i].path, &hooks[i].info );
+
+        printf( "  %-3s  %s%s%s\n", verdictNames[ verdict ], hooks[i].path,
+                reason != NULL ? ": " : "", reason != NULL ? reason : "" );
+
+        if ( verdict != kVerdictDisabled && getScopedConfigBool( "hook", hooks[i].name, "windowed", false ) )
+        {
+            /* not broken, as it still runs - but not when it's meant to */
+            char * problem = checkSpool( &user );
+            if ( problem != NULL )
+            {
+                printf( "       warning: windowed, but can't be spooled, so it will run immediately: %s\n", problem );
+                free( problem );
+            }
+        }
+
+        if ( manifest != NULL && strpbrk( hooks[i].path, "\t\n" ) == NULL )
+        {
+            if ( reason != NULL )
+            {
+                /* keep the manifest tab-separated */
+                for ( char * p = reason; *p != '\0'; ++p )
+                {
+                    if ( *p == '\t' || *p == '\n' ) *p = ' ';
+                }
+            }
+            fprintf( manifest, "%s\t%llu\t%lld\t%llu\t%s\t%s\n", verdictNames[ verdict ],
+                     (unsigned long long)hooks[i].info.st_ino, (long long)hooks[i].info.st_size,
+                     (unsigned long long)changeTime( &hooks[i].info ), hooks[i].path,
+                     reason != NULL ? reason : "" );
+        }
+
+        bad += ( verdict == kVerdictBad );
+        free( reason );
+        free( hooks[i].path );
+    }
+    free( hooks );
+
+    if ( count == 0 )
+    {
+        printf( "  (no hooks found)\n" );
+    }
+
+    if ( manifest != NULL )
+    {
+        if ( fclose( manifest ) != 0 || rename( tempPath, manifestPath ) != 0 )
+        {
+            reportErrno( "unable to update \'%s\'", manifestPath );
+            unlink( tempPath );
+        }
+    }
+    free( tempPath );
+    free( manifestPath );
+    free( (void *)user.name );
+
+    if ( bad > 0 )
+    {
+        printf( "%d broken hook%s will be skipped until %s fixed and verified again\n",
+                bad, bad == 1 ? "" : "s", bad == 1 ? "it is" : "they are" );
+    }
+    return ( bad > 0 ) ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file verify.h
+ *
+ * Health checks for hooks, so a broken one (bad shebang, missing interpreter,
+ * wrong permissions) is found when it's installed rather than when a recording
+ * finishes. The verdicts are kept in a manifest in the target's script directory,
+ * which invocations consult to skip hooks that are known to be broken without
+ * attempting to exec them.
+ *
+ * MIT Licensed
+ */
+
+#ifndef CUCKOO_VERIFY_H
+#define CUCKOO_VERIFY_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#define kManifestName   ".manifest"
+#define kSmokeArgs      "--version"
+#define kSmokeTimeout   10      /* seconds */
+
+typedef struct sManifestEntry tManifestEntry;
+
+typedef struct {
+    tManifestEntry * head;
+} tManifest;
+
+tManifest * loadManifest( const char * scriptsDir );
+bool        manifestSkip( const tManifest * manifest, const char * path, const struct stat * info );
+void        freeManifest( tManifest * manifest );
+
+int         verifyHooks( const char * installPath, const char * scriptsDir, const char * commonDir,
+                         const char * user, bool smoke );
+
+#endif /* CUCKOO_VERIFY_H */